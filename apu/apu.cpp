@@ -5,6 +5,12 @@
 \*****************************************************************************/
 
 #include <cmath>
+#ifdef USE_THREADS
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#endif
 #include "../snes9x.h"
 #include "apu.h"
 #include "../msu1.h"
@@ -27,6 +33,12 @@ static const int APU_DENOMINATOR_PAL    = 709379;
 // for use with SoundSync, multiplied by 2, for left and right samples.
 static const int MINIMUM_BUFFER_SIZE = 550 * 2;
 
+// Number of pending port/scanline messages the CPU may run ahead of the APU
+// thread before it has to wait. Scanlines are capped separately so the samples
+// produced before the next S9xLandSamples always fit in the resampler.
+static const int APU_THREAD_QUEUE_SIZE = 4096;
+static const int APU_THREAD_MAX_LINES  = 64;
+
 namespace SNES {
 #include "bapu/dsp/blargg_endian.h"
 CPU cpu;
@@ -38,6 +50,7 @@ static void *callback_data = NULL;
 
 static bool8 sound_in_sync = TRUE;
 static bool8 sound_enabled = FALSE;
+static bool8 silent = FALSE;
 
 static Resampler *resampler = NULL;
 
@@ -61,15 +74,59 @@ static int16 *resample_buffer = NULL;
 static int resample_buffer_size = 0;
 } // namespace msu
 
+#ifdef USE_THREADS
+// When Settings.ThreadedAPU is on, the SMP and DSP run on their own thread.
+// The CPU posts every catch-up point as a message carrying the number of SMP
+// clocks to run and an optional port write, so the APU thread replays exactly
+// the same sequence the synchronous path would. The CPU only waits when it
+// needs APU-owned state: port reads, samples, and snapshots.
+namespace apu_thread {
+enum
+{
+    MSG_WRITE_PORT   = 0x01,
+    MSG_END_SCANLINE = 0x02,
+    MSG_SILENT       = 0x04
+};
+
+struct message
+{
+    int32 ticks;
+    uint8 flags;
+    uint8 port;
+    uint8 data;
+};
+
+static std::thread thread;
+static std::mutex mutex;
+static std::condition_variable cond_pending;
+static std::condition_variable cond_idle;
+static message queue[APU_THREAD_QUEUE_SIZE];
+static int head = 0;
+static int tail = 0;
+static int lines = 0;
+static bool busy = false;
+static bool sleeping = false;
+static bool quit = false;
+
+// Only touched by the CPU thread; lets Sync() return without locking.
+static bool pending = false;
+
+static std::atomic<bool> samples_ready(false);
+} // namespace apu_thread
+#endif
+
 static void UpdatePlaybackRate(void);
 static void SPCSnapshotCallback(void);
 static inline int S9xAPUGetClock(int32);
 static inline int S9xAPUGetClockRemainder(int32);
+static void S9xAPUSync(void);
 
 bool8 S9xMixSamples(uint8 *dest, int sample_count)
 {
     int16 *out = (int16 *)dest;
 
+    S9xAPUSync();
+
     if (Settings.Mute)
     {
         memset(out, 0, sample_count << 1);
@@ -85,7 +142,7 @@ bool8 S9xMixSamples(uint8 *dest, int sample_count)
             {
                 if (msu::resampler->avail() >= sample_count)
                 {
-                    if (msu::resample_buffer_size < sample_count)
+                    if (msu::resample_buffer_size < sample_count) // preallocated by S9xInitSound
                     {
                         if (msu::resample_buffer)
                             delete[] msu::resample_buffer;
@@ -122,11 +179,17 @@ bool8 S9xMixSamples(uint8 *dest, int sample_count)
 
 int S9xGetSampleCount(void)
 {
+    S9xAPUSync();
     return spc::resampler->avail();
 }
 
 void S9xLandSamples(void)
 {
+    S9xAPUSync();
+#ifdef USE_THREADS
+    apu_thread::samples_ready = false;
+#endif
+
     if (spc::callback != NULL)
         spc::callback(spc::callback_data);
 
@@ -139,6 +202,7 @@ void S9xLandSamples(void)
 
 void S9xClearSamples(void)
 {
+    S9xAPUSync();
     spc::resampler->clear();
     if (Settings.MSU1)
         msu::resampler->clear();
@@ -170,6 +234,9 @@ void S9xUpdateDynamicRate(int avail, int buffer_size)
 
 static void UpdatePlaybackRate(void)
 {
+    // The APU thread writes into the resamplers; let it finish first
+    S9xAPUSync();
+
     if (Settings.SoundInputRate == 0)
         Settings.SoundInputRate = APU_DEFAULT_INPUT_RATE;
 
@@ -198,6 +265,8 @@ bool8 S9xInitSound(int buffer_ms)
     if (requested_buffer_size_samples > buffer_size_samples)
         buffer_size_samples = requested_buffer_size_samples;
 
+    S9xAPUSync();
+
     if (!spc::resampler)
     {
         spc::resampler = new Resampler(buffer_size_samples);
@@ -217,11 +286,24 @@ bool8 S9xInitSound(int buffer_ms)
     else
         msu::resampler->resize(buffer_size_samples * 3 / 2);
 
+    spc::resampler->set_quality(Settings.ResamplerQuality);
+    msu::resampler->set_quality(Settings.ResamplerQuality);
+
     SNES::dsp.spc_dsp.set_output(spc::resampler);
     S9xMSU1SetOutput(msu::resampler);
 
     UpdatePlaybackRate();
 
+    // S9xMixSamples can be asked for everything the DSP resampler holds, stretched
+    // to the playback rate; allocate the MSU-1 mix buffer for that up front
+    int msu_samples = (int)(buffer_size_samples * ((double)Settings.SoundPlaybackRate / Settings.SoundInputRate) * 1.05) + 16;
+    if (msu::resample_buffer_size < msu_samples)
+    {
+        delete[] msu::resample_buffer;
+        msu::resample_buffer = new int16[msu_samples];
+        msu::resample_buffer_size = msu_samples;
+    }
+
     spc::sound_enabled = S9xOpenSoundDevice();
 
     return (spc::sound_enabled);
@@ -229,6 +311,7 @@ bool8 S9xInitSound(int buffer_ms)
 
 void S9xSetSoundControl(uint8 voice_switch)
 {
+    S9xAPUSync();
     SNES::dsp.spc_dsp.set_stereo_switch(voice_switch << 8 | voice_switch);
 }
 
@@ -241,6 +324,7 @@ void S9xSetSoundMute(bool8 mute)
 
 void S9xDumpSPCSnapshot(void)
 {
+    S9xAPUSync();
     SNES::dsp.spc_dsp.dump_spc_snapshot();
 }
 
@@ -260,6 +344,20 @@ bool8 S9xInitAPU(void)
 
 void S9xDeinitAPU(void)
 {
+#ifdef USE_THREADS
+    if (apu_thread::thread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(apu_thread::mutex);
+            apu_thread::quit = true;
+        }
+        apu_thread::cond_pending.notify_one();
+        apu_thread::thread.join();
+        apu_thread::quit = false;
+        apu_thread::pending = false;
+    }
+#endif
+
     if (spc::resampler)
     {
         delete spc::resampler;
@@ -272,6 +370,10 @@ void S9xDeinitAPU(void)
         msu::resampler = NULL;
     }
 
+    delete[] msu::resample_buffer;
+    msu::resample_buffer = NULL;
+    msu::resample_buffer_size = 0;
+
     S9xMSU1DeInit();
 }
 
@@ -287,14 +389,148 @@ static inline int S9xAPUGetClockRemainder(int32 cpucycles)
            spc::ratio_denominator;
 }
 
+// Returns the number of SMP clocks elapsed since the last catch-up point and
+// moves the reference point to the current CPU time.
+static inline int32 S9xAPUAdvanceClock(void)
+{
+    int32 ticks = S9xAPUGetClock(CPU.Cycles);
+
+    spc::remainder = S9xAPUGetClockRemainder(CPU.Cycles);
+
+    S9xAPUSetReferenceTime(CPU.Cycles);
+
+    return ticks;
+}
+
+#ifdef USE_THREADS
+static inline bool8 S9xAPUThreaded(void)
+{
+    // MSU-1 audio is generated from the DSP output hook and reads CPU-side state
+    return (Settings.ThreadedAPU && !Settings.MSU1);
+}
+
+static void APUThreadProcess(const apu_thread::message &msg)
+{
+    SNES::smp.clock -= msg.ticks;
+    SNES::smp.enter();
+
+    if (msg.flags & apu_thread::MSG_WRITE_PORT)
+        SNES::cpu.port_write(msg.port, msg.data);
+
+    if (msg.flags & apu_thread::MSG_END_SCANLINE)
+    {
+        SNES::dsp.spc_dsp.set_silent((msg.flags & apu_thread::MSG_SILENT) != 0);
+        SNES::dsp.synchronize();
+
+        if (spc::resampler->space_filled() >= APU_SAMPLE_BLOCK)
+            apu_thread::samples_ready = true;
+    }
+}
+
+static void APUThreadMain(void)
+{
+    std::unique_lock<std::mutex> lock(apu_thread::mutex);
+
+    for (;;)
+    {
+        while (apu_thread::head == apu_thread::tail && !apu_thread::quit)
+        {
+            apu_thread::sleeping = true;
+            apu_thread::cond_pending.wait(lock);
+            apu_thread::sleeping = false;
+        }
+
+        if (apu_thread::head == apu_thread::tail)
+            break;
+
+        // Run everything queued so far without holding the lock; the CPU only
+        // ever appends at tail.
+        int pos = apu_thread::head;
+        int end = apu_thread::tail;
+        int lines_done = 0;
+        apu_thread::busy = true;
+        lock.unlock();
+
+        while (pos != end)
+        {
+            APUThreadProcess(apu_thread::queue[pos]);
+            if (apu_thread::queue[pos].flags & apu_thread::MSG_END_SCANLINE)
+                lines_done++;
+            pos = (pos + 1) % APU_THREAD_QUEUE_SIZE;
+        }
+
+        lock.lock();
+        apu_thread::head = end;
+        apu_thread::lines -= lines_done;
+        apu_thread::busy = false;
+        apu_thread::cond_idle.notify_all();
+    }
+}
+
+static void APUThreadPost(int32 ticks, uint8 flags, uint8 port = 0, uint8 data = 0)
+{
+    if (!apu_thread::thread.joinable())
+        apu_thread::thread = std::thread(APUThreadMain);
+
+    std::unique_lock<std::mutex> lock(apu_thread::mutex);
+
+    int next = (apu_thread::tail + 1) % APU_THREAD_QUEUE_SIZE;
+    while (next == apu_thread::head ||
+           ((flags & apu_thread::MSG_END_SCANLINE) && apu_thread::lines >= APU_THREAD_MAX_LINES))
+        apu_thread::cond_idle.wait(lock);
+
+    if (flags & apu_thread::MSG_END_SCANLINE)
+        apu_thread::lines++;
+
+    apu_thread::message &msg = apu_thread::queue[apu_thread::tail];
+    msg.ticks = ticks;
+    msg.flags = flags;
+    msg.port = port;
+    msg.data = data;
+    apu_thread::tail = next;
+    apu_thread::pending = true;
+
+    if (apu_thread::sleeping)
+        apu_thread::cond_pending.notify_one();
+}
+#endif
+
+// Waits until the APU thread has run every posted message, after which the CPU
+// thread may access SMP, DSP and resampler state directly.
+static void S9xAPUSync(void)
+{
+#ifdef USE_THREADS
+    if (!apu_thread::thread.joinable() || std::this_thread::get_id() == apu_thread::thread.get_id())
+        return;
+
+    if (!apu_thread::pending)
+        return;
+
+    std::unique_lock<std::mutex> lock(apu_thread::mutex);
+    while (apu_thread::head != apu_thread::tail || apu_thread::busy)
+        apu_thread::cond_idle.wait(lock);
+
+    apu_thread::pending = false;
+#endif
+}
+
 uint8 S9xAPUReadPort(int port)
 {
     S9xAPUExecute();
+    S9xAPUSync();
     return ((uint8)SNES::smp.port_read(port & 3));
 }
 
 void S9xAPUWritePort(int port, uint8 byte)
 {
+#ifdef USE_THREADS
+    if (S9xAPUThreaded())
+    {
+        APUThreadPost(S9xAPUAdvanceClock(), apu_thread::MSG_WRITE_PORT, port & 3, byte);
+        return;
+    }
+#endif
+
     S9xAPUExecute();
     SNES::cpu.port_write(port & 3, byte);
 }
@@ -306,19 +542,58 @@ void S9xAPUSetReferenceTime(int32 cpucycles)
 
 void S9xAPUExecute(void)
 {
-    SNES::smp.clock -= S9xAPUGetClock(CPU.Cycles);
+#ifdef USE_THREADS
+    if (S9xAPUThreaded())
+    {
+        APUThreadPost(S9xAPUAdvanceClock(), 0);
+        return;
+    }
+#endif
+
+    S9xAPUSync();
+
+    SNES::smp.clock -= S9xAPUAdvanceClock();
     SNES::smp.enter();
+}
 
-    spc::remainder = S9xAPUGetClockRemainder(CPU.Cycles);
+// In silent turbo the DSP skips producing samples and nothing is resampled
+// or handed to the port. Settings.Mute still delivers silent samples.
+static bool8 S9xAPUUpdateSilent(void)
+{
+    bool8 silent = Settings.TurboMode && Settings.SilentTurbo;
 
-    S9xAPUSetReferenceTime(CPU.Cycles);
+    if (silent != spc::silent)
+    {
+        spc::silent = silent;
+        S9xClearSamples();
+    }
+
+    return (silent);
 }
 
 void S9xAPUEndScanline(void)
 {
+    bool8 silent = S9xAPUUpdateSilent();
+
+#ifdef USE_THREADS
+    if (S9xAPUThreaded())
+    {
+        APUThreadPost(S9xAPUAdvanceClock(), apu_thread::MSG_END_SCANLINE | (silent ? apu_thread::MSG_SILENT : 0));
+
+        if (!silent && (apu_thread::samples_ready || !spc::sound_in_sync))
+            S9xLandSamples();
+
+        return;
+    }
+#endif
+
     S9xAPUExecute();
+    SNES::dsp.spc_dsp.set_silent(silent);
     SNES::dsp.synchronize();
 
+    if (silent)
+        return;
+
     if (spc::resampler->space_filled() >= APU_SAMPLE_BLOCK || !spc::sound_in_sync)
         S9xLandSamples();
 }
@@ -339,6 +614,8 @@ void S9xAPUTimingSetSpeedup(int ticks)
 
 void S9xResetAPU(void)
 {
+    S9xAPUSync();
+
     spc::reference_time = 0;
     spc::remainder = 0;
 
@@ -352,6 +629,8 @@ void S9xResetAPU(void)
 
 void S9xSoftResetAPU(void)
 {
+    S9xAPUSync();
+
     spc::reference_time = 0;
     spc::remainder = 0;
     SNES::cpu.reset();
@@ -365,6 +644,8 @@ void S9xAPUSaveState(uint8 *block)
 {
     uint8 *ptr = block;
 
+    S9xAPUSync();
+
     SNES::smp.save_state(&ptr);
     SNES::dsp.save_state(&ptr);
 
@@ -384,6 +665,8 @@ void S9xAPULoadState(uint8 *block)
 {
     uint8 *ptr = block;
 
+    S9xAPUSync();
+
     SNES::smp.load_state(&ptr);
     SNES::dsp.load_state(&ptr);
 
@@ -408,6 +691,8 @@ void S9xAPULoadBlarggState(uint8 *oldblock)
 {
     uint8 *ptr = oldblock;
 
+    S9xAPUSync();
+
     SNES::SPC_State_Copier copier(&ptr, to_var_from_buf);
 
     copier.copy(SNES::smp.apuram, 0x10000); // RAM
@@ -517,6 +802,8 @@ bool8 S9xSPCDump(const char *filename)
     if (!fs)
         return (FALSE);
 
+    S9xAPUSync();
+
     S9xSetSoundMute(TRUE);
 
     SNES::smp.save_spc(buf);
@@ -7,6 +7,11 @@
 #include "blargg_endian.h"
 #include <string.h>
 
+#if defined(__SSE2__) || defined(_M_X64)
+	#include <emmintrin.h>
+	#define SPC_DSP_SSE2 1
+#endif
+
 /* Copyright (C) 2007 Shay Green. This module is free software; you
 can redistribute it and/or modify it under the terms of the GNU Lesser
 General Public License as published by the Free Software Foundation; either
@@ -511,6 +516,147 @@ inline int SPC_DSP::interpolate( voice_t const* v )
     return out;
 }
 
+// Runs the gaussian filter for all playing voices at once at the start of a sample.
+// A voice's buf/interp_pos/env only change in its own V3c/V4, and register writes don't
+// touch them, so the result is identical to interpolate() when its V3c comes around.
+// Voices in KON setup are left to the scalar path, voices without envelope don't
+// need the result.
+inline void SPC_DSP::interpolate_voices()
+{
+	m.t_interp_mask = 0;
+
+#if SPC_DSP_SSE2
+	if ( Settings.InterpolationMethod != 2 )
+		return;
+
+	int mask = 0;
+	for ( int i = 0; i < voice_count; i++ )
+	{
+		voice_t const* v = &m.voices [i];
+		if ( !v->kon_delay && v->env )
+			mask |= v->vbit;
+	}
+
+	if ( !mask )
+		return;
+
+	BOOST::int16_t in   [4] [voice_count] = { { 0 } };
+	BOOST::int16_t filt [4] [voice_count] = { { 0 } };
+	for ( int i = 0; i < voice_count; i++ )
+	{
+		voice_t const* v = &m.voices [i];
+		if ( !(mask & v->vbit) )
+			continue;
+
+		int const* vin = &v->buf [(v->interp_pos >> 12) + v->buf_pos];
+		int offset = v->interp_pos >> 4 & 0xFF;
+		short const* fwd = gauss + 255 - offset;
+		short const* rev = gauss       + offset;
+
+		in [0] [i] = (BOOST::int16_t) vin [0];
+		in [1] [i] = (BOOST::int16_t) vin [1];
+		in [2] [i] = (BOOST::int16_t) vin [2];
+		in [3] [i] = (BOOST::int16_t) vin [3];
+		filt [0] [i] = fwd [  0];
+		filt [1] [i] = fwd [256];
+		filt [2] [i] = rev [256];
+		filt [3] [i] = rev [  0];
+	}
+
+	// 16x16->32 products, (p >> 11) per tap, (int16_t) wrap after the third tap
+	__m128i lo = _mm_setzero_si128();
+	__m128i hi = _mm_setzero_si128();
+	for ( int t = 0; t < 4; t++ )
+	{
+		__m128i a  = _mm_loadu_si128( (__m128i const*) in   [t] );
+		__m128i b  = _mm_loadu_si128( (__m128i const*) filt [t] );
+		__m128i pl = _mm_mullo_epi16( a, b );
+		__m128i ph = _mm_mulhi_epi16( a, b );
+
+		if ( t == 3 )
+		{
+			lo = _mm_srai_epi32( _mm_slli_epi32( lo, 16 ), 16 );
+			hi = _mm_srai_epi32( _mm_slli_epi32( hi, 16 ), 16 );
+		}
+
+		lo = _mm_add_epi32( lo, _mm_srai_epi32( _mm_unpacklo_epi16( pl, ph ), 11 ) );
+		hi = _mm_add_epi32( hi, _mm_srai_epi32( _mm_unpackhi_epi16( pl, ph ), 11 ) );
+	}
+
+	// Saturating pack is CLAMP16
+	BOOST::int16_t out [voice_count];
+	__m128i r = _mm_and_si128( _mm_packs_epi32( lo, hi ), _mm_set1_epi16( ~1 ) );
+	_mm_storeu_si128( (__m128i*) out, r );
+
+	for ( int i = 0; i < voice_count; i++ )
+		m.t_interp_out [i] = out [i];
+	m.t_interp_mask = mask;
+#endif
+}
+
+// Runs every filter and BRR buffer position of all eight voices, with random and
+// full-scale samples and random voices idle, through interpolate_voices() and
+// interpolate(). Returns the number of mismatches, or -1 without a batched path.
+// Voice state is restored afterwards.
+int SPC_DSP::check_interpolate_voices()
+{
+#if SPC_DSP_SSE2
+	voice_t saved [voice_count];
+	memcpy( saved, m.voices, sizeof saved );
+	int const method = Settings.InterpolationMethod;
+	Settings.InterpolationMethod = 2;
+
+	unsigned seed = 1;
+	int errors = 0;
+	for ( int pass = 0; pass < 3; pass++ )
+	for ( int buf_pos = 0; buf_pos < brr_buf_size; buf_pos++ )
+	for ( int pos = 0; pos < 0x8000; pos += voice_count )
+	{
+		int playing = 0;
+		for ( int i = 0; i < voice_count; i++ )
+		{
+			voice_t* v = &m.voices [i];
+			seed = seed * 1103515245 + 12345;
+			v->vbit       = 1 << i;
+			v->buf_pos    = buf_pos;
+			v->interp_pos = pos + i;
+			v->kon_delay  = (seed >> 8 & 7) ? 0 : 1;
+			v->env        = (seed >> 12 & 7) ? 0x7FF : 0;
+			if ( !v->kon_delay && v->env )
+				playing |= v->vbit;
+
+			for ( int j = 0; j < brr_buf_size; j++ )
+			{
+				seed = seed * 1103515245 + 12345;
+				int s = (int16_t) (seed >> 16);
+				if ( pass == 1 )
+					s = (s & 1) ? 0x7FFF : -0x8000; // wraps and clamps
+				else if ( pass == 2 )
+					s >>= 4;
+				v->buf [j] = v->buf [j + brr_buf_size] = s;
+			}
+		}
+
+		interpolate_voices();
+		if ( m.t_interp_mask != playing )
+			errors++;
+
+		for ( int i = 0; i < voice_count; i++ )
+		{
+			if ( (m.t_interp_mask & playing) & m.voices [i].vbit )
+				errors += m.t_interp_out [i] != interpolate( &m.voices [i] );
+		}
+	}
+
+	memcpy( m.voices, saved, sizeof saved );
+	Settings.InterpolationMethod = method;
+	m.t_interp_mask = 0;
+	return errors;
+#else
+	return -1;
+#endif
+}
+
 //// Counters
 
 int const simple_counter_range = 2048 * 5 * 3; // 30720
@@ -818,7 +964,19 @@ inline VOICE_CLOCK( V3c )
 
 	// Gaussian interpolation
 	{
-		int output = interpolate( v );
+		// A voice without envelope is scaled to 0 below whatever it interpolates
+		int output = 0;
+		if ( m.t_interp_mask & v->vbit && Settings.InterpolationMethod == 2 )
+		{
+			output = m.t_interp_out [v->voice_number];
+
+			#ifndef NDEBUG
+				// batched result must match the scalar filter for this voice
+				assert( output == interpolate( v ) );
+			#endif
+		}
+		else if ( v->env )
+			output = interpolate( v );
 
 		// Noise
 		if ( m.t_non & v->vbit )
@@ -858,12 +1016,18 @@ inline VOICE_CLOCK( V3c )
 inline void SPC_DSP::voice_output( voice_t const* v, int ch )
 {
 	// Apply left/right volume
+	if ( silent && !(m.t_eon & v->vbit) )
+		return;
+
 	int amp = (m.t_output * (int8_t) VREG(v->regs,voll + ch)) >> 7;
 	amp *= ((stereo_switch & (1 << (v->voice_number + ch * voice_count))) ? 1 : 0);
 
 	// Add to output total
-	m.t_main_out [ch] += amp;
-	CLAMP16( m.t_main_out [ch] );
+	if ( !silent )
+	{
+		m.t_main_out [ch] += amp;
+		CLAMP16( m.t_main_out [ch] );
+	}
 
 	// Optionally add to echo total
 	if ( m.t_eon & v->vbit )
@@ -962,10 +1126,10 @@ VOICE_CLOCK(V9_V6_V3) { voice_V9(v); voice_V6(v+1); voice_V3(v+2); }
 #define ECHO_PTR( ch )      ((Settings.SeparateEchoBuffer) ? (&m.separate_echo_buffer [m.t_echo_ptr + ch * 2]) : (&m.ram [m.t_echo_ptr + ch * 2]))
 
 // Sample in echo history buffer, where 0 is the oldest
-#define ECHO_FIR( i )       (m.echo_hist_pos [i])
+#define ECHO_FIR( i, ch )   (m.echo_hist [ch] [m.echo_hist_pos + (i)])
 
 // Calculate FIR point for left/right channel
-#define CALC_FIR( i, ch )   ((ECHO_FIR( i + 1 ) [ch] * (int8_t) REG(fir + i * 0x10)) >> 6)
+#define CALC_FIR( i, ch )   ((ECHO_FIR( i + 1, ch ) * (int8_t) REG(fir + i * 0x10)) >> 6)
 
 #define ECHO_CLOCK( n ) inline void SPC_DSP::echo_##n()
 
@@ -973,53 +1137,118 @@ inline void SPC_DSP::echo_read( int ch )
 {
 	int s = GET_LE16SA( ECHO_PTR( ch ) );
 	// second copy simplifies wrap-around handling
-	ECHO_FIR( 0 ) [ch] = ECHO_FIR( 8 ) [ch] = s >> 1;
+	ECHO_FIR( 0, ch ) = ECHO_FIR( 8, ch ) = s >> 1;
 }
 
-ECHO_CLOCK( 22 )
+// Hardware reads tap 0 on clock 22, 1-2 on 23, 3-5 on 24 and 6-7 on 25. The whole
+// sum is done on clock 25 instead; taps 0-5 are only added together before the
+// int16 wrap, so a coefficient changed in between is fixed up by echo_fir_write().
+inline void SPC_DSP::echo_fir( int* out_l, int* out_r )
 {
-	// History
-	if ( ++m.echo_hist_pos >= &m.echo_hist [echo_hist_size] )
-		m.echo_hist_pos = m.echo_hist;
+	int l = m.t_echo_in [0];
+	int r = m.t_echo_in [1];
+
+#if SPC_DSP_SSE2
+	BOOST::int16_t coefs [8];
+	for ( int i = 0; i < 8; i++ )
+		coefs [i] = (int8_t) REG(fir + i * 0x10);
+
+	__m128i c  = _mm_loadu_si128( (__m128i const*) coefs );
+	__m128i hl = _mm_loadu_si128( (__m128i const*) &ECHO_FIR( 1, 0 ) );
+	__m128i hr = _mm_loadu_si128( (__m128i const*) &ECHO_FIR( 1, 1 ) );
+
+	// (s * c) >> 6 per tap, 0-3 and 4-7
+	__m128i pl = _mm_mullo_epi16( hl, c ), ql = _mm_mulhi_epi16( hl, c );
+	__m128i pr = _mm_mullo_epi16( hr, c ), qr = _mm_mulhi_epi16( hr, c );
+	__m128i l0 = _mm_srai_epi32( _mm_unpacklo_epi16( pl, ql ), 6 );
+	__m128i l1 = _mm_srai_epi32( _mm_unpackhi_epi16( pl, ql ), 6 );
+	__m128i r0 = _mm_srai_epi32( _mm_unpacklo_epi16( pr, qr ), 6 );
+	__m128i r1 = _mm_srai_epi32( _mm_unpackhi_epi16( pr, qr ), 6 );
+
+	int const l7 = _mm_cvtsi128_si32( _mm_srli_si128( l1, 12 ) );
+	int const r7 = _mm_cvtsi128_si32( _mm_srli_si128( r1, 12 ) );
+
+	// Sum taps 0-6 of both channels
+	__m128i no7 = _mm_set_epi32( 0, -1, -1, -1 );
+	__m128i sl  = _mm_add_epi32( l0, _mm_and_si128( l1, no7 ) );
+	__m128i sr  = _mm_add_epi32( r0, _mm_and_si128( r1, no7 ) );
+	__m128i sum = _mm_add_epi32( _mm_unpacklo_epi32( sl, sr ), _mm_unpackhi_epi32( sl, sr ) );
+	sum = _mm_add_epi32( sum, _mm_srli_si128( sum, 8 ) );
+
+	l += _mm_cvtsi128_si32( sum );
+	r += _mm_cvtsi128_si32( _mm_srli_si128( sum, 4 ) );
+#else
+	for ( int i = 0; i < 7; i++ )
+	{
+		l += CALC_FIR( i, 0 );
+		r += CALC_FIR( i, 1 );
+	}
 
-	m.t_echo_ptr = (m.t_esa * 0x100 + m.echo_offset) & 0xFFFF;
-	echo_read( 0 );
+	int const l7 = CALC_FIR( 7, 0 );
+	int const r7 = CALC_FIR( 7, 1 );
+#endif
+
+	l = (int16_t) l;
+	r = (int16_t) r;
 
-	// FIR (using l and r temporaries below helps compiler optimize)
-	int l = CALC_FIR( 0, 0 );
-	int r = CALC_FIR( 0, 1 );
+	l += (int16_t) l7;
+	r += (int16_t) r7;
 
-	m.t_echo_in [0] = l;
-	m.t_echo_in [1] = r;
+	*out_l = l;
+	*out_r = r;
 }
-ECHO_CLOCK( 23 )
-{
-	int l = CALC_FIR( 1, 0 ) + CALC_FIR( 2, 0 );
-	int r = CALC_FIR( 1, 1 ) + CALC_FIR( 2, 1 );
 
-	m.t_echo_in [0] += l;
-	m.t_echo_in [1] += r;
+// FIR taps hardware has read so far this sample, for the clock about to run
+static int echo_fir_taps_read( int phase )
+{
+	// Clocks 23, 24 and 25
+	static unsigned char const taps_read [3] = { 1, 3, 6 };
+	return ( (unsigned) (phase - 23) < 3 ) ? taps_read [phase - 23] : 0;
+}
 
-	echo_read( 1 );
+// Sum of the first taps of the FIR with the current coefficients
+int SPC_DSP::echo_fir_sum( int ch, int taps )
+{
+	int sum = 0;
+	for ( int i = 0; i < taps; i++ )
+		sum += CALC_FIR( i, ch );
+	return sum;
 }
-ECHO_CLOCK( 24 )
+
+void SPC_DSP::echo_fir_write( int i, int data )
 {
-	int l = CALC_FIR( 3, 0 ) + CALC_FIR( 4, 0 ) + CALC_FIR( 5, 0 );
-	int r = CALC_FIR( 3, 1 ) + CALC_FIR( 4, 1 ) + CALC_FIR( 5, 1 );
+	if ( i >= echo_fir_taps_read( m.phase ) )
+		return;
 
-	m.t_echo_in [0] += l;
-	m.t_echo_in [1] += r;
+	int const old = (int8_t) m.regs [r_fir + i * 0x10];
+	for ( int ch = 0; ch < 2; ch++ )
+	{
+		int const s = ECHO_FIR( i + 1, ch );
+		m.t_echo_in [ch] += ((s * old) >> 6) - ((s * (int8_t) data) >> 6);
+	}
 }
-ECHO_CLOCK( 25 )
+
+ECHO_CLOCK( 22 )
 {
-	int l = m.t_echo_in [0] + CALC_FIR( 6, 0 );
-	int r = m.t_echo_in [1] + CALC_FIR( 6, 1 );
+	// History
+	if ( ++m.echo_hist_pos >= echo_hist_size )
+		m.echo_hist_pos = 0;
 
-	l = (int16_t) l;
-	r = (int16_t) r;
+	m.t_echo_ptr = (m.t_esa * 0x100 + m.echo_offset) & 0xFFFF;
+	echo_read( 0 );
 
-	l += (int16_t) CALC_FIR( 7, 0 );
-	r += (int16_t) CALC_FIR( 7, 1 );
+	// FIR is summed on clock 25
+	m.t_echo_in [0] = 0;
+	m.t_echo_in [1] = 0;
+}
+ECHO_CLOCK( 23 )
+{
+	echo_read( 1 );
+}
+ECHO_CLOCK( 25 )
+{
+	int l, r;
+	echo_fir( &l, &r );
 
 	CLAMP16( l );
 	CLAMP16( r );
@@ -1038,7 +1267,8 @@ ECHO_CLOCK( 26 )
 {
 	// Left output volumes
 	// (save sample for next clock so we can output both together)
-	m.t_main_out [0] = echo_output( 0 );
+	if ( !silent )
+		m.t_main_out [0] = echo_output( 0 );
 
 	// Echo feedback
 	int l = m.t_echo_out [0] + (int16_t) ((m.t_echo_in [0] * (int8_t) REG(efb)) >> 7);
@@ -1052,6 +1282,17 @@ ECHO_CLOCK( 26 )
 }
 ECHO_CLOCK( 27 )
 {
+	if ( silent )
+	{
+		m.t_main_out [0] = 0;
+		m.t_main_out [1] = 0;
+
+		// MSU-1 audio still has to advance in step with the DSP
+		if ( Settings.MSU1 )
+			S9xMSU1Generate( 2 );
+		return;
+	}
+
 	// Output
 	int l = m.t_main_out [0];
 	int r = echo_output( 1 );
@@ -1124,7 +1365,7 @@ V(V9_V6_V3,2) -> V(V9,2) V(V6,3) V(V3,4) */
 
 // Voice      0      1      2      3      4      5      6      7
 #define GEN_DSP_TIMING \
-PHASE( 0)  V(V5,0)V(V2,1)\
+PHASE( 0)  interpolate_voices(); V(V5,0)V(V2,1)\
 PHASE( 1)  V(V6,0)V(V3,1)\
 PHASE( 2)  V(V7_V4_V1,0)\
 PHASE( 3)  V(V8_V5_V2,0)\
@@ -1148,7 +1389,7 @@ PHASE(20)         V(V1,1)                            V(V7,6)V(V4,7)\
 PHASE(21)                                            V(V8,6)V(V5,7)  V(V2,0)  /* t_brr_next_addr order dependency */\
 PHASE(22)  V(V3a,0)                                  V(V9,6)V(V6,7)  echo_22();\
 PHASE(23)                                                   V(V7,7)  echo_23();\
-PHASE(24)                                                   V(V8,7)  echo_24();\
+PHASE(24)                                                   V(V8,7)\
 PHASE(25)  V(V3b,0)                                         V(V9,7)  echo_25();\
 PHASE(26)                                                            echo_26();\
 PHASE(27) misc_27();                                                 echo_27();\
@@ -1192,6 +1433,7 @@ void SPC_DSP::init( void* ram_64k )
 	reset();
 
 	stereo_switch = 0xffff;
+	silent = false;
 	take_spc_snapshot = 0;
 	spc_snapshot_callback = 0;
 
@@ -1216,10 +1458,11 @@ void SPC_DSP::soft_reset_common()
 	require( m.ram ); // init() must have been called already
 
 	m.noise              = 0x4000;
-	m.echo_hist_pos      = m.echo_hist;
+	m.echo_hist_pos      = 0;
 	m.every_other_sample = 1;
 	m.echo_offset        = 0;
 	m.phase              = 0;
+	m.t_interp_mask      = 0;
 
     memset(m.separate_echo_buffer, 0, 0x10000);
 
@@ -1348,13 +1591,14 @@ void SPC_DSP::copy_state( unsigned char** io, copy_func_t copy )
 		int j;
 		for ( j = 0; j < 2; j++ )
 		{
-			int s = m.echo_hist_pos [i] [j];
+			int s = ECHO_FIR( i, j );
 			SPC_COPY( int16_t, s );
-			m.echo_hist [i] [j] = s; // write back at offset 0
+			m.echo_hist [j] [i] = s; // write back at offset 0
 		}
 	}
-	m.echo_hist_pos = m.echo_hist;
-	memcpy( &m.echo_hist [echo_hist_size], m.echo_hist, echo_hist_size * sizeof m.echo_hist [0] );
+	m.echo_hist_pos = 0;
+	for ( i = 0; i < 2; i++ )
+		memcpy( &m.echo_hist [i] [echo_hist_size], m.echo_hist [i], echo_hist_size * sizeof m.echo_hist [i] [0] );
 
 	// Misc
 	SPC_COPY(  uint8_t, m.every_other_sample );
@@ -1389,8 +1633,18 @@ void SPC_DSP::copy_state( unsigned char** io, copy_func_t copy )
 	SPC_COPY(  int16_t, m.t_main_out [1] );
 	SPC_COPY(  int16_t, m.t_echo_out [0] );
 	SPC_COPY(  int16_t, m.t_echo_out [1] );
-	SPC_COPY(  int16_t, m.t_echo_in  [0] );
-	SPC_COPY(  int16_t, m.t_echo_in  [1] );
+
+	// Between clocks 23 and 25 t_echo_in only holds fix-ups for FIR writes,
+	// states keep the sum of the taps read so far as staggered reads had it
+	{
+		int const taps = echo_fir_taps_read( m.phase );
+		for ( i = 0; i < 2; i++ )
+		{
+			int s = (int16_t) (m.t_echo_in [i] + echo_fir_sum( i, taps ));
+			SPC_COPY(  int16_t, s );
+			m.t_echo_in [i] = s - echo_fir_sum( i, taps );
+		}
+	}
 
 	SPC_COPY( uint16_t, m.t_dir_addr );
 	SPC_COPY( uint16_t, m.t_pitch );
@@ -1398,6 +1652,9 @@ void SPC_DSP::copy_state( unsigned char** io, copy_func_t copy )
 	SPC_COPY( uint16_t, m.t_echo_ptr );
 	SPC_COPY(  uint8_t, m.t_looped );
 
+	// Not saved; the remaining voices of this sample fall back to interpolate()
+	m.t_interp_mask = 0;
+
 	copier.extra();
 }
 #endif
@@ -1420,6 +1677,13 @@ void SPC_DSP::set_stereo_switch( int value )
 	stereo_switch = value;
 }
 
+// Skips everything that only feeds the output samples. Voices, envelopes,
+// ENDX/ENVX/OUTX and echo writes to ARAM are still emulated.
+void SPC_DSP::set_silent( bool value )
+{
+	silent = value;
+}
+
 SPC_DSP::uint8_t SPC_DSP::reg_value( int ch, int addr )
 {
 	return m.voices[ch].regs[addr];
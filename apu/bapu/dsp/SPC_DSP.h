@@ -67,15 +67,23 @@ public:
 	// Returns non-zero if new key-on events occurred since last call
 	bool check_kon();
 
+// Self check
+
+	// Compares the batched gaussian filter with the per-voice one over every filter
+	// and buffer position. Returns the number of mismatches, -1 if not built.
+	int check_interpolate_voices();
+
 // Snes9x Accessor
 
 	int     stereo_switch;
+	bool    silent;
 	int     take_spc_snapshot;
 	void    (*spc_snapshot_callback) (void);
 
 	void    set_spc_snapshot_callback( void (*callback) (void) );
 	void    dump_spc_snapshot( void );
 	void    set_stereo_switch( int );
+	void    set_silent( bool );
 	uint8_t reg_value( int, int );
 	int     envx_value( int );
 
@@ -143,9 +151,10 @@ private:
 	{
 		uint8_t regs [register_count];
 
-		// Echo history keeps most recent 8 samples (twice the size to simplify wrap handling)
-		int echo_hist [echo_hist_size * 2] [2];
-		int (*echo_hist_pos) [2]; // &echo_hist [0 to 7]
+		// Echo history keeps most recent 8 samples per channel (twice the size to simplify
+		// wrap handling, and so the eight FIR taps are always contiguous)
+		int16_t echo_hist [2] [echo_hist_size * 2];
+		int echo_hist_pos;      // 0 to 7
 
 		int every_other_sample; // toggles every sample
 		int kon;                // KON value when last checked
@@ -186,6 +195,8 @@ private:
 		int t_output;
 		int t_looped;
 		int t_echo_ptr;
+		int t_interp_mask;      // voices whose interpolation was done ahead by interpolate_voices()
+		int t_interp_out [voice_count];
 
 		// left/right sums
 		int t_main_out [2];
@@ -212,6 +223,7 @@ private:
 	unsigned read_counter( int rate );
 
 	int  interpolate( voice_t const* v );
+	void interpolate_voices();
 	void run_envelope( voice_t* const v );
 	void decode_brr( voice_t* v );
 
@@ -240,9 +252,11 @@ private:
 	void echo_read( int ch );
 	int  echo_output( int ch );
 	void echo_write( int ch );
+	void echo_fir( int* l, int* r );
+	void echo_fir_write( int i, int data );
+	int  echo_fir_sum( int ch, int taps );
 	void echo_22();
 	void echo_23();
-	void echo_24();
 	void echo_25();
 	void echo_26();
 	void echo_27();
@@ -267,6 +281,10 @@ inline void SPC_DSP::write( int addr, int data )
 {
 	assert( (unsigned) addr < register_count );
 
+	// FIR taps already read this sample must keep their old coefficient
+	if ( (addr & 0x0F) == r_fir && (unsigned) (m.phase - 23) < 3 )
+		echo_fir_write( addr >> 4, data );
+
 	m.regs [addr] = (uint8_t) data;
 	switch ( addr & 0x0F )
 	{
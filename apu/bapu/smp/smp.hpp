@@ -16,6 +16,7 @@ public:
   void load_state(uint8 **);
   void save_state(uint8 **);
   void save_spc (uint8 *);
+  void load_spc (const uint8 *);
   SMP();
   ~SMP();
 
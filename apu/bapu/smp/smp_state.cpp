@@ -69,6 +69,52 @@ void SMP::save_spc (uint8 *block) {
   memcpy (block, &out, 66048);
 }
 
+void SMP::load_spc (const uint8 *block) {
+  const spc_file *in = (const spc_file *) block;
+
+  memcpy (apuram, in->apuram, 65536);
+
+  opcode_number = 0;
+  opcode_cycle = 0;
+
+  regs.pc = in->pc_low | (in->pc_high << 8);
+  regs.B.a = in->a;
+  regs.x = in->x;
+  regs.B.y = in->y;
+  regs.p = in->psw;
+  regs.sp = in->sp;
+
+  // The snapshot holds what mmio_read returned, so port bytes are what the
+  // SMP would read from the CPU and counters are the pending timer outputs
+  uint8 control = in->apuram[0xf1];
+  status.iplrom_enable = control & 0x80;
+  status.dsp_addr = in->apuram[0xf2];
+  status.ram00f8 = in->apuram[0xf8];
+  status.ram00f9 = in->apuram[0xf9];
+
+  for (int i = 0; i < 4; i++)
+  {
+      cpu.port_write (i, in->apuram[0xf4 + i]);
+  }
+
+  timer0.enable = control & 0x01;
+  timer1.enable = control & 0x02;
+  timer2.enable = control & 0x04;
+  timer0.target = in->apuram[0xfa];
+  timer1.target = in->apuram[0xfb];
+  timer2.target = in->apuram[0xfc];
+  timer0.stage1_ticks = timer1.stage1_ticks = timer2.stage1_ticks = 0;
+  timer0.stage2_ticks = timer1.stage2_ticks = timer2.stage2_ticks = 0;
+  timer0.stage3_ticks = in->apuram[0xfd] & 15;
+  timer1.stage3_ticks = in->apuram[0xfe] & 15;
+  timer2.stage3_ticks = in->apuram[0xff] & 15;
+
+  rd = wr = dp = sp = ya = bit = 0;
+
+  dsp.spc_dsp.load (in->dsp_registers);
+  dsp.clock = 0;
+}
+
 
 void SMP::save_state(uint8 **block) {
   uint8 *ptr = *block;
@@ -15,10 +15,17 @@
 #include <stdint.h>
 #endif
 #include <cmath>
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#endif
 
 class Resampler
 {
   public:
+    enum { SINC_PHASES = 256, SINC_MAX_TAPS = 32 };
+
     int size;
     int buffer_size;
     int start;
@@ -28,6 +35,16 @@ class Resampler
     float r_frac;
     int   r_left[4], r_right[4];
 
+    // Windowed-sinc polyphase filter, used instead of hermite when sinc_taps != 0.
+    // Table has SINC_PHASES + 1 rows of sinc_taps coefficients, oldest tap first.
+    int    sinc_taps;
+    float  sinc_scale;
+    float  sinc_beta;
+    float  sinc_cutoff;
+    float *sinc_table;
+    float  r_hist[2][SINC_MAX_TAPS * 2]; // doubled so the window is always contiguous
+    int    r_hist_pos;
+
     static inline int16_t short_clamp(int n)
     {
         return (int16_t)(((int16_t)n != n) ? (n >> 31) ^ 0x7fff : n);
@@ -56,11 +73,56 @@ class Resampler
         return (a0 * b) + (a1 * m0) + (a2 * m1) + (a3 * c);
     }
 
+    static double bessel_i0(double x)
+    {
+        double sum = 1.0, term = 1.0;
+
+        for (int k = 1; term > sum * 1e-12; k++)
+        {
+            term *= (x * x) / (4.0 * k * k);
+            sum += term;
+        }
+
+        return sum;
+    }
+
+    void build_sinc_table(void)
+    {
+        int half = sinc_taps / 2;
+        double i0_beta = bessel_i0(sinc_beta);
+
+        for (int p = 0; p <= SINC_PHASES; p++)
+        {
+            float *row = sinc_table + p * sinc_taps;
+            double mu = (double)p / SINC_PHASES;
+            double coef[SINC_MAX_TAPS];
+            double sum = 0.0;
+
+            for (int k = 0; k < sinc_taps; k++)
+            {
+                // Distance from the output point, which lies between taps half - 1 and half
+                double x = k - (half - 1) - mu;
+                double t = x / half;
+                double w = bessel_i0(sinc_beta * sqrt(t < 1.0 ? 1.0 - t * t : 0.0)) / i0_beta;
+                double a = 3.14159265358979323846 * sinc_cutoff * x;
+
+                coef[k] = w * (a == 0.0 ? 1.0 : sin(a) / a);
+                sum += coef[k];
+            }
+
+            // Unity gain at DC for every phase
+            for (int k = 0; k < sinc_taps; k++)
+                row[k] = (float)(coef[k] / sum);
+        }
+    }
+
     Resampler()
     {
         this->buffer_size = 0;
         buffer = NULL;
         r_step = 1.0;
+        sinc_taps = 0;
+        sinc_table = NULL;
     }
 
     Resampler(int num_samples)
@@ -68,6 +130,8 @@ class Resampler
         this->buffer_size = num_samples;
         buffer = new int16_t[this->buffer_size];
         r_step = 1.0;
+        sinc_taps = 0;
+        sinc_table = NULL;
         clear();
     }
 
@@ -75,11 +139,54 @@ class Resampler
     {
         delete[] buffer;
         buffer = NULL;
+        delete[] sinc_table;
+        sinc_table = NULL;
+    }
+
+    // 0: cubic hermite, 1-3: windowed sinc with 8, 16 or 32 taps
+    void set_quality(int quality)
+    {
+        static const int   taps[4]  = { 0, 8, 16, 32 };
+        static const float scale[4] = { 0.0f, 0.80f, 0.88f, 0.93f };
+        static const float beta[4]  = { 0.0f, 5.0f, 6.5f, 8.0f };
+
+        if (quality < 0 || quality > 3)
+            quality = 0;
+
+        if (taps[quality] == sinc_taps)
+            return;
+
+        delete[] sinc_table;
+        sinc_table = NULL;
+        sinc_taps = taps[quality];
+
+        // The table is built by the next time_ratio() or read(), once the ratio is known
+        if (sinc_taps)
+        {
+            sinc_scale = scale[quality];
+            sinc_beta = beta[quality];
+            sinc_table = new float[(SINC_PHASES + 1) * sinc_taps];
+            sinc_cutoff = 0.0f;
+        }
+
+        clear();
     }
 
     inline void time_ratio(double ratio)
     {
         r_step = ratio;
+
+        if (sinc_taps)
+        {
+            // Lower the cutoff when downsampling; dynamic rate control only nudges
+            // the ratio, so don't rebuild the table for small changes
+            float cutoff = sinc_scale * (ratio > 1.0 ? 1.0 / ratio : 1.0);
+            if (fabs(cutoff - sinc_cutoff) > 0.01f)
+            {
+                sinc_cutoff = cutoff;
+                build_sinc_table();
+            }
+        }
     }
 
     inline void clear(void)
@@ -94,6 +201,9 @@ class Resampler
         r_frac = 0.0;
         r_left[0] = r_left[1] = r_left[2] = r_left[3] = 0;
         r_right[0] = r_right[1] = r_right[2] = r_right[3] = 0;
+
+        memset(r_hist, 0, sizeof(r_hist));
+        r_hist_pos = 0;
     }
 
     inline bool pull(int16_t *dst, int num_samples)
@@ -155,6 +265,13 @@ class Resampler
         }
 
         assert((num_samples & 1) == 0); // resampler always processes both stereo samples
+
+        if (sinc_taps)
+        {
+            read_sinc(data, num_samples);
+            return;
+        }
+
         int o_position = 0;
 
         while (o_position < num_samples && size > 0)
@@ -197,6 +314,103 @@ class Resampler
         }
     }
 
+    inline void sinc_point(float mu, int16_t *out)
+    {
+        float phase = mu * SINC_PHASES;
+        int p = (int)phase;
+        if (p >= SINC_PHASES)
+            p = SINC_PHASES - 1;
+        float fract = phase - p;
+
+        const float *c0 = sinc_table + p * sinc_taps;
+        const float *c1 = c0 + sinc_taps;
+        const float *hl = &r_hist[0][r_hist_pos];
+        const float *hr = &r_hist[1][r_hist_pos];
+        float l, r;
+
+#if defined(__AVX__)
+        __m256 f = _mm256_set1_ps(fract);
+        __m256 al = _mm256_setzero_ps();
+        __m256 ar = _mm256_setzero_ps();
+        for (int k = 0; k < sinc_taps; k += 8)
+        {
+            __m256 a = _mm256_loadu_ps(c0 + k);
+            __m256 c = _mm256_add_ps(a, _mm256_mul_ps(f, _mm256_sub_ps(_mm256_loadu_ps(c1 + k), a)));
+            al = _mm256_add_ps(al, _mm256_mul_ps(c, _mm256_loadu_ps(hl + k)));
+            ar = _mm256_add_ps(ar, _mm256_mul_ps(c, _mm256_loadu_ps(hr + k)));
+        }
+        __m128 sl = _mm_add_ps(_mm256_castps256_ps128(al), _mm256_extractf128_ps(al, 1));
+        __m128 sr = _mm_add_ps(_mm256_castps256_ps128(ar), _mm256_extractf128_ps(ar, 1));
+#elif defined(__SSE__) || defined(_M_X64)
+        __m128 f = _mm_set1_ps(fract);
+        __m128 sl = _mm_setzero_ps();
+        __m128 sr = _mm_setzero_ps();
+        for (int k = 0; k < sinc_taps; k += 4)
+        {
+            __m128 a = _mm_loadu_ps(c0 + k);
+            __m128 c = _mm_add_ps(a, _mm_mul_ps(f, _mm_sub_ps(_mm_loadu_ps(c1 + k), a)));
+            sl = _mm_add_ps(sl, _mm_mul_ps(c, _mm_loadu_ps(hl + k)));
+            sr = _mm_add_ps(sr, _mm_mul_ps(c, _mm_loadu_ps(hr + k)));
+        }
+#endif
+
+#if defined(__AVX__) || defined(__SSE__) || defined(_M_X64)
+        // Horizontal sums: lanes 0 and 1 end up holding left and right
+        __m128 t = _mm_add_ps(_mm_unpacklo_ps(sl, sr), _mm_unpackhi_ps(sl, sr));
+        t = _mm_add_ps(t, _mm_movehl_ps(t, t));
+        l = _mm_cvtss_f32(t);
+        r = _mm_cvtss_f32(_mm_shuffle_ps(t, t, 1));
+#else
+        l = r = 0.0f;
+        for (int k = 0; k < sinc_taps; k++)
+        {
+            float c = c0[k] + fract * (c1[k] - c0[k]);
+            l += c * hl[k];
+            r += c * hr[k];
+        }
+#endif
+
+        out[0] = short_clamp((int)l);
+        out[1] = short_clamp((int)r);
+    }
+
+    void read_sinc(int16_t *data, int num_samples)
+    {
+        int o_position = 0;
+
+        if (sinc_cutoff == 0.0f)
+            time_ratio(r_step);
+
+        while (o_position < num_samples && size > 0)
+        {
+            while (r_frac <= 1.0 && o_position < num_samples)
+            {
+                sinc_point(r_frac, data + o_position);
+                o_position += 2;
+
+                r_frac += r_step;
+            }
+
+            if (r_frac > 1.0)
+            {
+                // Window is r_hist[r_hist_pos .. r_hist_pos + sinc_taps - 1], newest last;
+                // each sample is stored twice so the window never wraps
+                if (++r_hist_pos >= sinc_taps)
+                    r_hist_pos = 0;
+                int newest = r_hist_pos + sinc_taps - 1;
+                r_hist[0][newest] = r_hist[0][newest % sinc_taps] = buffer[start];
+                r_hist[1][newest] = r_hist[1][newest % sinc_taps] = buffer[start + 1];
+
+                r_frac -= 1.0;
+
+                start += 2;
+                if (start >= buffer_size)
+                    start -= buffer_size;
+                size -= 2;
+            }
+        }
+    }
+
     inline int space_empty(void) const
     {
         return buffer_size - size;
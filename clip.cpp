@@ -16,8 +16,23 @@ static uint8	region_map[6][6] =
 	{ 0,    0,    0,    0,    0, 0x10 }
 };
 
+// Windows are often animated by HDMA through a small set of positions that repeat
+// every frame, so the computed regions are kept in a direct-mapped cache keyed by
+// everything S9xComputeClipWindows reads. It is sized for one distinct window per
+// visible line, enough to hold a whole spotlight or wipe.
+#define CLIP_CACHE_SIZE	256
+
+struct ClipCacheEntry
+{
+	uint32			Key[3];
+	struct ClipData	Clip[2][6];
+};
+
+static struct ClipCacheEntry	clip_cache[CLIP_CACHE_SIZE];
+
 static inline uint8 CalcWindowMask (int, uint8, uint8);
 static inline void StoreWindowRegions (uint8, struct ClipData *, int, int16 *, uint8 *, bool8, bool8 s = FALSE);
+static void ComputeClipWindows (void);
 
 
 static inline uint8 CalcWindowMask (int i, uint8 W1, uint8 W2)
@@ -99,7 +114,7 @@ static inline void StoreWindowRegions (uint8 Mask, struct ClipData *Clip, int n_
 	Clip->Count = ct;
 }
 
-void S9xComputeClipWindows (void)
+static void ComputeClipWindows (void)
 {
 	int16	windows[6] = { 0, 256, 256, 256, 256, 256 };
 	uint8	drawing_modes[5] = { 0, 0, 0, 0, 0 };
@@ -232,3 +247,32 @@ void S9xComputeClipWindows (void)
 		}
 	}
 }
+
+void S9xComputeClipWindows (void)
+{
+	uint32	key[3];
+
+	key[0] = PPU.Window1Left | (PPU.Window1Right << 8) | (PPU.Window2Left << 16) | ((uint32) PPU.Window2Right << 24);
+	key[1] = (Memory.FillRAM[0x2130] & 0xf0) << 20 | (Settings.DisableGraphicWindows ? 0x10000000 : 0);
+	key[2] = (Memory.FillRAM[0x212e] & 0x1f) << 12 | (Memory.FillRAM[0x212f] & 0x1f) << 17 | 0x80000000; // never matches the zeroed cache
+
+	for (int i = 0; i < 6; i++)
+	{
+		key[1] |= ((PPU.ClipWindow1Enable[i] ? 1 : 0) | (PPU.ClipWindow2Enable[i] ? 2 : 0) | (PPU.ClipWindow1Inside[i] ? 4 : 0) | (PPU.ClipWindow2Inside[i] ? 8 : 0)) << (i * 4);
+		key[2] |= (PPU.ClipWindowOverlapLogic[i] & 3) << (i * 2);
+	}
+
+	uint32	hash = key[0] ^ (key[0] >> 13) ^ (key[1] * 0x9e3779b1) ^ (key[2] * 0x85ebca6b);
+	struct ClipCacheEntry	*entry = &clip_cache[(hash ^ (hash >> 16)) & (CLIP_CACHE_SIZE - 1)];
+
+	if (entry->Key[0] == key[0] && entry->Key[1] == key[1] && entry->Key[2] == key[2])
+	{
+		memcpy(IPPU.Clip, entry->Clip, sizeof(IPPU.Clip));
+		return;
+	}
+
+	ComputeClipWindows();
+
+	memcpy(entry->Key, key, sizeof(key));
+	memcpy(entry->Clip, IPPU.Clip, sizeof(IPPU.Clip));
+}
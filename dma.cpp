@@ -22,8 +22,48 @@ extern SPC7110	s7emu;
 
 static uint8	sdd1_decode_buffer[0x10000];
 
+#define HDMA_PROGRAM_SIZE	256
+
+// One HDMA table entry as HDMAReadLineCount() found it. The pointers depend
+// only on the address and the memory map, so an entry holds as long as the
+// channel reaches the same DMA[].Address with the same banks; the line count
+// and the indirect address are still read through them every time.
+struct SHDMAEntry
+{
+	uint16	Address;
+	uint16	IndirectAddress;
+	uint8	*Line;
+	uint8	*Indirect;
+	uint8	*Data;
+};
+
+struct SHDMAProgram
+{
+	uint8	ABank;
+	uint8	IndirectBank;
+	bool8	HDMAIndirectAddressing;
+	int		Count;
+	int		Next;
+	struct SHDMAEntry	Entry[HDMA_PROGRAM_SIZE];
+};
+
+static struct SHDMAProgram	HDMAPrograms[8];
+
 static inline bool8 addCyclesInDMA (uint8);
+static inline uint8 * HDMATablePointer (uint32);
+static inline struct SHDMAEntry * HDMAProgramEntry (int);
+static void HDMAProgramRecord (int, uint16, uint8 *);
 static inline bool8 HDMAReadLineCount (int);
+static inline int32 DMARunLength (uint8, int32);
+static void MarkVRAMRows (uint32, uint32);
+static int32 DMABulkTransfer (uint8, uint8 *, uint16 &, int32, int32 &, int32 &);
+
+enum
+{
+	DMA_BULK_NONE,
+	DMA_BULK_DONE,
+	DMA_BULK_KILLED
+};
 
 
 static inline bool8 addCyclesInDMA (uint8 dma_channel)
@@ -49,6 +89,193 @@ static inline bool8 addCyclesInDMA (uint8 dma_channel)
 	return (TRUE);
 }
 
+static inline int32 DMARunLength (uint8 dma_channel, int32 count)
+{
+	// Number of bytes that can be moved before addCyclesInDMA would have
+	// anything to do besides adding their cycles.
+	if (CPU.HDMARanInDMA & (1 << dma_channel))
+		return (0);
+
+	int32	n = CPU.NextEvent - 1 - CPU.Cycles;
+	if (n < SLOW_ONE_CYCLE)
+		return (0);
+
+	n /= SLOW_ONE_CYCLE;
+	return (n < count ? n : count);
+}
+
+static void MarkVRAMRows (uint32 address, uint32 size)
+{
+	// Same as REGISTER_2118 and REGISTER_2119 do byte by byte
+	uint32	first = address >> 4, last = (address + size - 1) >> 4;
+
+	for (uint32 r = first; r <= last; r++)
+		IPPU.VRAMDirtyRows[(r >> 5) & 127] |= 1 << (r & 31);
+
+	IPPU.VRAMDirty = TRUE;
+}
+
+// Fast path DMA to OAM, VRAM, CGRAM and WRAM. The bytes that can be moved
+// before CPU.NextEvent go as one run with their cycles added at once, and only
+// the byte that reaches the event goes through addCyclesInDMA. Runs of whole
+// VRAM words written in order, the usual mode 1 upload, are copied with memcpy.
+// Returns DMA_BULK_NONE for the transfers it leaves to the byte loops.
+static int32 DMABulkTransfer (uint8 Channel, uint8 *base, uint16 &p, int32 inc, int32 &count, int32 &b)
+{
+	SDMA	*d = &DMA[Channel];
+	bool8	words = FALSE;
+	bool8	tile = PPU.VMA.FullGraphicCount != 0;
+
+	if (d->TransferMode == 0 || d->TransferMode == 2 || d->TransferMode == 6)
+	{
+		if (d->BAddress != 0x04 && d->BAddress != 0x18 && d->BAddress != 0x19 && d->BAddress != 0x22 && d->BAddress != 0x80)
+			return (DMA_BULK_NONE);
+	}
+	else
+	if ((d->TransferMode == 1 || d->TransferMode == 5) && d->BAddress == 0x18)
+		words = TRUE;
+	else
+		return (DMA_BULK_NONE);
+
+	bool8	wram = !CPU.InWRAMDMAorHDMA;
+
+	while (count > 0)
+	{
+		int32	n = DMARunLength(Channel, count);
+		bool8	event = (n == 0);
+		if (event)
+			n = 1;
+
+		if (words)
+		{
+			if (!tile && PPU.VMA.High && PPU.VMA.Increment == 1 && inc == 1 &&
+				(PPU.ForcedBlanking || CPU.V_Counter >= PPU.ScreenHeight + FIRST_VISIBLE_LINE))
+			{
+				uint32	address = ((PPU.VMA.Address << 1) & 0xffff) + b;
+				int32	first = 0x10000 - address;
+
+				if (first > n)
+					first = n;
+
+				memcpy(Memory.VRAM + address, base + p, first);
+				memcpy(Memory.VRAM, base + p + first, n - first);
+				MarkVRAMRows(address, n);
+
+				// The high byte is also left on the bus
+				int32	high = ((b + n - 1) & 1) ? n - 1 : n - 2;
+				if (high >= 0)
+					OpenBus = *(base + p + high);
+
+				PPU.VMA.Address += (b + n) >> 1;
+				b = (b + n) & 1;
+				p += n;
+			}
+			else
+			if (!tile)
+			{
+				for (int32 i = 0; i < n; i++, p += inc, b ^= 1)
+				{
+					if (!b)
+						REGISTER_2118_linear(*(base + p));
+					else
+					{
+						OpenBus = *(base + p);
+						REGISTER_2119_linear(OpenBus);
+					}
+				}
+			}
+			else
+			{
+				for (int32 i = 0; i < n; i++, p += inc, b ^= 1)
+				{
+					if (!b)
+						REGISTER_2118_tile(*(base + p));
+					else
+						REGISTER_2119_tile(*(base + p));
+				}
+			}
+		}
+		else
+		{
+			switch (d->BAddress)
+			{
+				case 0x04: // OAMDATA
+					for (int32 i = 0; i < n; i++, p += inc)
+						REGISTER_2104(*(base + p));
+					break;
+
+				case 0x18: // VMDATAL
+					for (int32 i = 0; i < n; i++, p += inc)
+					{
+						if (!tile)
+							REGISTER_2118_linear(*(base + p));
+						else
+							REGISTER_2118_tile(*(base + p));
+					}
+
+					break;
+
+				case 0x19: // VMDATAH
+					for (int32 i = 0; i < n; i++, p += inc)
+					{
+						if (!tile)
+							REGISTER_2119_linear(*(base + p));
+						else
+							REGISTER_2119_tile(*(base + p));
+					}
+
+					break;
+
+				case 0x22: // CGDATA
+					for (int32 i = 0; i < n; i++, p += inc)
+						REGISTER_2122(*(base + p));
+					break;
+
+				case 0x80: // WMDATA
+					if (wram && inc == 1)
+					{
+						int32	first = 0x20000 - PPU.WRAM;
+
+						if (first > n)
+							first = n;
+
+						memcpy(Memory.RAM + PPU.WRAM, base + p, first);
+						memcpy(Memory.RAM, base + p + first, n - first);
+						PPU.WRAM = (PPU.WRAM + n) & 0x1ffff;
+						p += n;
+					}
+					else
+					if (wram)
+					{
+						for (int32 i = 0; i < n; i++, p += inc)
+							REGISTER_2180(*(base + p));
+					}
+					else
+						p += n * inc;
+
+					break;
+			}
+		}
+
+		d->TransferBytes -= n;
+		d->AAddress += n * inc;
+		count -= n;
+
+		if (event)
+		{
+			if (!addCyclesInDMA(Channel))
+				return (DMA_BULK_KILLED);
+		}
+		else
+		{
+			ADD_CYCLES(n * SLOW_ONE_CYCLE);
+			CPU.HDMARanInDMA = 0;
+		}
+	}
+
+	return (DMA_BULK_DONE);
+}
+
 bool8 S9xDoDMA (uint8 Channel)
 {
 	CPU.InDMA = TRUE;
@@ -555,6 +782,20 @@ bool8 S9xDoDMA (uint8 Channel)
 			else
 			{
 				// DMA FAST PATH
+				int32	bulk = DMABulkTransfer(Channel, base, p, inc, count, b);
+
+				if (bulk == DMA_BULK_KILLED)
+				{
+					CPU.InDMA = FALSE;
+					CPU.InDMAorHDMA = FALSE;
+					CPU.InWRAMDMAorHDMA = FALSE;
+					CPU.CurrentDMAorHDMAChannel = -1;
+					return (FALSE);
+				}
+
+				if (bulk == DMA_BULK_DONE)
+					count = 0;
+				else
 				if (d->TransferMode == 0 || d->TransferMode == 2 || d->TransferMode == 6)
 				{
 					switch (d->BAddress)
@@ -1128,13 +1369,88 @@ bool8 S9xDoDMA (uint8 Channel)
 	return (TRUE);
 }
 
+static inline uint8 * HDMATablePointer (uint32 address)
+{
+	// Only plain memory reads the same through a pointer as by S9xGetByte()
+	uint8	*p = Memory.Map[(address & 0xffffff) >> MEMMAP_SHIFT];
+
+	return (p >= (uint8 *) CMemory::MAP_LAST ? p + (address & 0xffff) : NULL);
+}
+
+static inline struct SHDMAEntry * HDMAProgramEntry (int d)
+{
+	struct SHDMAProgram	*prog = &HDMAPrograms[d];
+
+	if (prog->Next < prog->Count)
+	{
+		struct SHDMAEntry	*e = &prog->Entry[prog->Next];
+
+		if (e->Address == DMA[d].Address && prog->ABank == DMA[d].ABank &&
+			prog->IndirectBank == DMA[d].IndirectBank && prog->HDMAIndirectAddressing == DMA[d].HDMAIndirectAddressing)
+		{
+			prog->Next++;
+			return (e);
+		}
+
+		// The table went another way, record it from here
+		prog->Count = prog->Next;
+	}
+
+	return (NULL);
+}
+
+static void HDMAProgramRecord (int d, uint16 address, uint8 *data)
+{
+	struct SHDMAProgram	*prog = &HDMAPrograms[d];
+
+	// These chips switch the memory map while running
+	if (Settings.SA1 || Settings.SDD1 || Settings.SPC7110 || Settings.BS)
+		return;
+
+	if (prog->Next != prog->Count || prog->Count >= HDMA_PROGRAM_SIZE)
+		return;
+
+	if (prog->Count == 0 || prog->ABank != DMA[d].ABank ||
+		prog->IndirectBank != DMA[d].IndirectBank || prog->HDMAIndirectAddressing != DMA[d].HDMAIndirectAddressing)
+	{
+		prog->ABank = DMA[d].ABank;
+		prog->IndirectBank = DMA[d].IndirectBank;
+		prog->HDMAIndirectAddressing = DMA[d].HDMAIndirectAddressing;
+		prog->Count = prog->Next = 0;
+	}
+
+	struct SHDMAEntry	*e = &prog->Entry[prog->Count++];
+	uint32				a = (DMA[d].ABank << 16) + address;
+
+	prog->Next = prog->Count;
+
+	e->Address = address;
+	e->IndirectAddress = DMA[d].IndirectAddress;
+	e->Line = HDMATablePointer(a);
+	e->Indirect = NULL;
+	e->Data = data;
+
+	if (DMA[d].HDMAIndirectAddressing)
+	{
+		// S9xGetWord() takes care of a word split across two blocks
+		a = (DMA[d].ABank << 16) + (uint16) (address + 1);
+		if ((a & MEMMAP_MASK) != MEMMAP_MASK)
+			e->Indirect = HDMATablePointer(a);
+	}
+}
+
 static inline bool8 HDMAReadLineCount (int d)
 {
 	// CPU.InDMA is set, so S9xGetXXX() / S9xSetXXX() incur no charges.
 
+	struct SHDMAEntry	*e = HDMAProgramEntry(d);
+	uint16	address = DMA[d].Address;
 	uint8	line;
 
-	line = S9xGetByte((DMA[d].ABank << 16) + DMA[d].Address);
+	if (e && e->Line)
+		line = *e->Line;
+	else
+		line = S9xGetByte((DMA[d].ABank << 16) + DMA[d].Address);
 	ADD_CYCLES(SLOW_ONE_CYCLE);
 
 	if (!line)
@@ -1179,13 +1495,33 @@ static inline bool8 HDMAReadLineCount (int d)
 	if (DMA[d].HDMAIndirectAddressing)
 	{
 		ADD_CYCLES(SLOW_ONE_CYCLE << 1);
-		DMA[d].IndirectAddress = S9xGetWord((DMA[d].ABank << 16) + DMA[d].Address);
+		if (e && e->Indirect)
+			DMA[d].IndirectAddress = READ_WORD(e->Indirect);
+		else
+			DMA[d].IndirectAddress = S9xGetWord((DMA[d].ABank << 16) + DMA[d].Address);
 		DMA[d].Address += 2;
-		HDMAMemPointers[d] = S9xGetMemPointer((DMA[d].IndirectBank << 16) + DMA[d].IndirectAddress);
+
+		if (e && e->IndirectAddress == DMA[d].IndirectAddress)
+			HDMAMemPointers[d] = e->Data;
+		else
+		{
+			HDMAMemPointers[d] = S9xGetMemPointer((DMA[d].IndirectBank << 16) + DMA[d].IndirectAddress);
+			if (e)
+			{
+				e->IndirectAddress = DMA[d].IndirectAddress;
+				e->Data = HDMAMemPointers[d];
+			}
+		}
 	}
+	else
+	if (e)
+		HDMAMemPointers[d] = e->Data;
 	else
 		HDMAMemPointers[d] = S9xGetMemPointer((DMA[d].ABank << 16) + DMA[d].Address);
 
+	if (!e)
+		HDMAProgramRecord(d, address, HDMAMemPointers[d]);
+
 	return (TRUE);
 }
 
@@ -1216,6 +1552,7 @@ void S9xStartHDMA (void)
 			CPU.CurrentDMAorHDMAChannel = i;
 
 			DMA[i].Address = DMA[i].AAddress;
+			HDMAPrograms[i].Next = 0;
 
 			if (!HDMAReadLineCount(i))
 			{
@@ -1631,5 +1968,7 @@ void S9xResetDMA (void)
 		DMA[d].UnknownByte = 0xff;
 		DMA[d].DoTransfer = FALSE;
 		DMA[d].UnusedBit43x0 = 1;
+
+		HDMAPrograms[d].Count = HDMAPrograms[d].Next = 0;
 	}
 }
@@ -4,6 +4,12 @@
    For further information, consult the LICENSE file in the root directory.
 \*****************************************************************************/
 
+#ifdef USE_THREADS
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#endif
 #include "snes9x.h"
 #include "ppu.h"
 #include "tile.h"
@@ -25,52 +31,189 @@ static int	font_width = 8, font_height = 9;
 void (*S9xCustomDisplayString) (const char *, int, int, bool, int) = NULL;
 
 static void SetupOBJ (void);
-static void DrawOBJS (int);
+static void DrawOBJS (struct SBG &, int);
 static void DisplayTime (void);
 static void DisplayFrameRate (void);
 static void DisplayPressedKeys (void);
 static void DisplayWatchedAddresses (void);
 static void DisplayStringFromBottom (const char *, int, int, bool);
-static void DrawBackground (int, uint8, uint8);
-static void DrawBackgroundMosaic (int, uint8, uint8);
-static void DrawBackgroundOffset (int, uint8, uint8, int);
-static void DrawBackgroundOffsetMosaic (int, uint8, uint8, int);
-static inline void DrawBackgroundMode7 (int, void (*DrawMath) (uint32, uint32, int), void (*DrawNomath) (uint32, uint32, int), int);
-static inline void DrawBackdrop (void);
-static inline void RenderScreen (bool8);
+static void DrawBackground (struct SBG &, int, uint8, uint8);
+static void DrawBackgroundMosaic (struct SBG &, int, uint8, uint8);
+static void DrawBackgroundOffset (struct SBG &, int, uint8, uint8, int);
+static void DrawBackgroundOffsetMosaic (struct SBG &, int, uint8, uint8, int);
+static inline void DrawBackgroundMode7 (struct SBG &, int, void (*DrawMath) (struct SBG &, uint32, uint32, int), void (*DrawNomath) (struct SBG &, uint32, uint32, int), int);
+static inline void DrawBackdrop (struct SBG &);
+static inline void RenderScreen (struct SBG &, bool8);
+static void RenderLines (struct SBG &, uint32, uint32, bool8);
+static void WidenLines (uint32, uint32);
+static void FinishLines (uint32, uint32);
+static void MarkRows (int32, int32);
+static void FlushRows (void);
 static uint16 get_crosshair_color (uint8);
 static void S9xDisplayStringType (const char *, int, int, bool, int);
 
-#define TILE_PLUS(t, x)	(((t) & 0xfc00) | ((t + x) & 0x3ff))
+static int32	redo_top = 0, redo_bottom = -1;		// rows to finish again before the frame is shown
+static uint8	rows_changed[SNES_HEIGHT_EXTENDED * 2];
+static int		shown_width = 0, shown_height = 0;
+static struct SBG	MainBG;								// renderer state of the emulation thread
+
+#ifdef USE_THREADS
+// With Settings.RenderThreads above 1, each screen update is cut into bands of
+// lines that are drawn at the same time, one of them on the emulation thread.
+// Nothing the renderer reads (PPU registers, VRAM, CGRAM, OAM, LineData, clip
+// windows) can change until the update returns, and every band is drawn with
+// its own SBG, so the bands don't depend on each other.
+namespace render_thread {
+static const int	MAX_THREADS    = 16;
+static const uint32	MIN_BAND_LINES = 16;
+
+static std::vector<std::thread>	threads;
+static std::mutex				mutex;
+static std::condition_variable	cond_start;
+static std::condition_variable	cond_done;
+static uint32	generation = 0;
+static int		pending = 0;
+static bool		quit = false;
+
+static int		bands = 0;
+static uint32	band_start[MAX_THREADS + 1];
+static bool8	sub;
+} // namespace render_thread
+
+static void RenderThreadMain (int band, uint32 seen)
+{
+	using namespace render_thread;
 
+	struct SBG	BG;
+	memset(&BG, 0, sizeof(BG));
 
-bool8 S9xGraphicsInit (void)
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			cond_start.wait(lock, [&] { return quit || generation != seen; });
+			if (quit)
+				return;
+			seen = generation;
+			if (band >= bands)
+				continue;
+		}
+
+		RenderLines(BG, band_start[band], band_start[band + 1] - 1, sub);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (--pending == 0)
+			cond_done.notify_one();
+	}
+}
+
+static void StopRenderThreads (void)
 {
-	S9xInitTileRenderer();
-	memset(BlackColourMap, 0, 256 * sizeof(uint16));
+	using namespace render_thread;
 
-	GFX.RealPPL = GFX.Pitch >> 1;
-	IPPU.OBJChanged = TRUE;
-	Settings.BG_Forced = 0;
-	S9xFixColourBrightness();
-	S9xBuildDirectColourMaps();
+	if (threads.empty())
+		return;
 
-	GFX.ZERO = (uint16 *) malloc(sizeof(uint16) * 0x10000);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
 
-	GFX.ScreenSize = GFX.Pitch / 2 * SNES_HEIGHT_EXTENDED * (Settings.SupportHiRes ? 2 : 1);
-	GFX.SubScreen  = (uint16 *) malloc(GFX.ScreenSize * sizeof(uint16));
-	GFX.ZBuffer    = (uint8 *)  malloc(GFX.ScreenSize);
-	GFX.SubZBuffer = (uint8 *)  malloc(GFX.ScreenSize);
+	cond_start.notify_all();
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+
+	threads.clear();
+	quit = false;
+}
+
+static void StartRenderThreads (int count)
+{
+	StopRenderThreads();
+
+	for (int i = 1; i < count; i++)
+		render_thread::threads.push_back(std::thread(RenderThreadMain, i, render_thread::generation));
+}
 
-	if (!GFX.ZERO || !GFX.SubScreen || !GFX.ZBuffer || !GFX.SubZBuffer)
+// Splits StartY..EndY into bands of at least MIN_BAND_LINES lines. Splits are
+// moved up to the start of a mosaic block, since a block takes its scroll
+// values from the first line drawn.
+static bool8 RenderBandsThreaded (uint32 StartY, uint32 EndY, bool8 sub)
+{
+	using namespace render_thread;
+
+	int	count = Settings.RenderThreads > (uint32) MAX_THREADS ? MAX_THREADS : (int) Settings.RenderThreads;
+	if (count < 2)
 	{
-		S9xGraphicsDeinit();
+		StopRenderThreads();
+		return (FALSE);
+	}
+
+	if ((int) threads.size() != count - 1)
+		StartRenderThreads(count);
+
+	uint32	lines = EndY - StartY + 1;
+	if (lines < MIN_BAND_LINES * 2)
+		return (FALSE);
+
+	if (lines < MIN_BAND_LINES * count)
+		count = lines / MIN_BAND_LINES;
+
+	// Mosaic blocks of an update starting above PPU.MosaicStart don't line
+	// up with MosaicStart, so a band boundary would restart them
+	if (PPU.Mosaic > 1 && StartY < PPU.MosaicStart)
+		return (FALSE);
+
+	int	n = 0;
+	band_start[n++] = StartY;
+
+	for (int i = 1; i < count; i++)
+	{
+		uint32	y = StartY + lines * i / count;
+
+		if (PPU.Mosaic > 1)
+			y -= ((uint32) y - PPU.MosaicStart) % PPU.Mosaic;
+
+		if (y > band_start[n - 1] && y <= EndY)
+			band_start[n++] = y;
+	}
+
+	if (n < 2)
 		return (FALSE);
+
+	band_start[n] = EndY + 1;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		bands = n;
+		pending = n - 1;
+		render_thread::sub = sub;
+		generation++;
 	}
 
-	// Lookup table for 1/2 color subtraction
+	cond_start.notify_all();
+
+	RenderLines(MainBG, band_start[0], band_start[1] - 1, sub);
+
+	std::unique_lock<std::mutex> lock(mutex);
+	cond_done.wait(lock, [] { return pending == 0; });
+
+	MainBG.StartY = StartY;
+	MainBG.EndY = EndY;
+
+	return (TRUE);
+}
+#endif
+
+
+// Lookup table for 1/2 color subtraction
+template<class F>
+static void BuildZERO (void)
+{
+	const uint32	green_hi = (F::MaxGreen + 1) >> 1;
+
 	memset(GFX.ZERO, 0, 0x10000 * sizeof(uint16));
-	for (uint32 r = 0; r <= MAX_RED; r++)
+	for (uint32 r = 0; r <= (uint32) F::MaxRed; r++)
 	{
 		uint32	r2 = r;
 		if (r2 & 0x10)
@@ -78,15 +221,15 @@ bool8 S9xGraphicsInit (void)
 		else
 			r2 = 0;
 
-		for (uint32 g = 0; g <= MAX_GREEN; g++)
+		for (uint32 g = 0; g <= (uint32) F::MaxGreen; g++)
 		{
 			uint32	g2 = g;
-			if (g2 & GREEN_HI_BIT)
-				g2 &= ~GREEN_HI_BIT;
+			if (g2 & green_hi)
+				g2 &= ~green_hi;
 			else
 				g2 = 0;
 
-			for (uint32 b = 0; b <= MAX_BLUE; b++)
+			for (uint32 b = 0; b <= (uint32) F::MaxBlue; b++)
 			{
 				uint32	b2 = b;
 				if (b2 & 0x10)
@@ -94,21 +237,69 @@ bool8 S9xGraphicsInit (void)
 				else
 					b2 = 0;
 
-				GFX.ZERO[BUILD_PIXEL2(r, g, b)] = BUILD_PIXEL2(r2, g2, b2);
-				GFX.ZERO[BUILD_PIXEL2(r, g, b) & ~ALPHA_BITS_MASK] = BUILD_PIXEL2(r2, g2, b2);
+				GFX.ZERO[F::Build2(r, g, b)] = F::Build2(r2, g2, b2);
+				GFX.ZERO[F::Build2(r, g, b) & ~F::AlphaMask] = F::Build2(r2, g2, b2);
 			}
 		}
 	}
+}
+
+bool8 S9xGraphicsInit (void)
+{
+	if (GFX.PixelFormat != 565 && GFX.PixelFormat != 555)
+		GFX.PixelFormat = PIXEL_BUILD::Format;
+
+	S9xInitTileRenderer();
+	memset(BlackColourMap, 0, 256 * sizeof(uint16));
+
+	GFX.RealPPL = GFX.Pitch >> 1;
+	IPPU.OBJChanged = TRUE;
+	Settings.BG_Forced = 0;
+	S9xFixColourBrightness();
+	S9xBuildDirectColourMaps();
+
+	GFX.ZERO = (uint16 *) malloc(sizeof(uint16) * 0x10000);
+
+	GFX.ScreenSize = GFX.Pitch / 2 * SNES_HEIGHT_EXTENDED * (Settings.SupportHiRes ? 2 : 1);
+	GFX.SubScreen  = (uint16 *) malloc(GFX.ScreenSize * sizeof(uint16));
+	GFX.ZBuffer    = (uint8 *)  malloc(GFX.ScreenSize);
+	GFX.SubZBuffer = (uint8 *)  malloc(GFX.ScreenSize);
+	GFX.MathBuffer = (uint8 *)  malloc(GFX.ScreenSize);
+	GFX.ShownScreen = NULL;
+
+	if (GFX.TrackChangedRows)
+		GFX.ShownScreen = (uint16 *) malloc(GFX.ScreenSize * sizeof(uint16));
+
+	shown_width = shown_height = 0;
+
+	if (!GFX.ZERO || !GFX.SubScreen || !GFX.ZBuffer || !GFX.SubZBuffer || !GFX.MathBuffer || (GFX.TrackChangedRows && !GFX.ShownScreen))
+	{
+		S9xGraphicsDeinit();
+		return (FALSE);
+	}
+
+	if (S9xPixelFormat555())
+		BuildZERO<PIXEL_RGB555>();
+	else
+		BuildZERO<PIXEL_RGB565>();
 
 	return (TRUE);
 }
 
 void S9xGraphicsDeinit (void)
 {
+#ifdef USE_THREADS
+	StopRenderThreads();
+#endif
+
 	if (GFX.ZERO)       { free(GFX.ZERO);       GFX.ZERO       = NULL; }
 	if (GFX.SubScreen)  { free(GFX.SubScreen);  GFX.SubScreen  = NULL; }
 	if (GFX.ZBuffer)    { free(GFX.ZBuffer);    GFX.ZBuffer    = NULL; }
 	if (GFX.SubZBuffer) { free(GFX.SubZBuffer); GFX.SubZBuffer = NULL; }
+	if (GFX.MathBuffer) { free(GFX.MathBuffer); GFX.MathBuffer = NULL; }
+	if (GFX.ShownScreen) { free(GFX.ShownScreen); GFX.ShownScreen = NULL; }
+
+	S9xFreeBGLineCache();
 }
 
 void S9xGraphicsScreenResize (void)
@@ -159,7 +350,7 @@ void S9xBuildDirectColourMaps (void)
 
 	for (uint32 p = 0; p < 8; p++)
 		for (uint32 c = 0; c < 256; c++)
-			DirectColourMaps[p][c] = BUILD_PIXEL(IPPU.XB[((c & 7) << 2) | ((p & 1) << 1)], IPPU.XB[((c & 0x38) >> 1) | (p & 2)], IPPU.XB[((c & 0xc0) >> 3) | (p & 4)]);
+			DirectColourMaps[p][c] = S9xBuildPixel(IPPU.XB[((c & 7) << 2) | ((p & 1) << 1)], IPPU.XB[((c & 0x38) >> 1) | (p & 2)], IPPU.XB[((c & 0xc0) >> 3) | (p & 4)]);
 }
 
 void S9xStartScreenRefresh (void)
@@ -186,6 +377,8 @@ void S9xStartScreenRefresh (void)
 		PPU.MosaicStart = 0;
 		PPU.RecomputeClipWindows = TRUE;
 		IPPU.PreviousLine = IPPU.CurrentLine = 0;
+		redo_top = 0;
+		redo_bottom = -1;
 
 		memset(GFX.ZBuffer, 0, GFX.ScreenSize);
 		memset(GFX.SubZBuffer, 0, GFX.ScreenSize);
@@ -213,6 +406,7 @@ void S9xEndScreenRefresh (void)
 		if (GFX.DoInterlace && GFX.InterlaceFrame == 0)
 		{
 			S9xControlEOF();
+			FlushRows();
 			S9xContinueUpdate(IPPU.RenderedScreenWidth, IPPU.RenderedScreenHeight);
 		}
 		else
@@ -232,7 +426,9 @@ void S9xEndScreenRefresh (void)
 			if (Settings.AutoDisplayMessages)
 				S9xDisplayMessages(GFX.Screen, GFX.RealPPL, IPPU.RenderedScreenWidth, IPPU.RenderedScreenHeight, 1);
 
+			FlushRows();
 			S9xDeinitUpdate(IPPU.RenderedScreenWidth, IPPU.RenderedScreenHeight);
+			memset(rows_changed, 0, sizeof(rows_changed));
 		}
 	}
 	else
@@ -309,33 +505,59 @@ void RenderLine (uint8 C)
 	else
 	{
 		// if we're not rendering this frame, we still need to update this
+		// unless the game has never looked at it, see S9xUpdateRangeTimeOver()
 		// XXX: Check ForceBlank? Or anything else?
-		if (IPPU.OBJChanged)
+		if (!PPU.OBJRangeRead)
+			return;
+		if (IPPU.OBJChanged || IPPU.OBJDirty)
 			SetupOBJ();
 		PPU.RangeTimeOver |= GFX.OBJLines[C].RTOFlags;
 	}
 }
 
-static inline void RenderScreen (bool8 sub)
+void S9xUpdateRangeTimeOver (void)
+{
+	// First read of $213E: from now on skipped frames keep RangeTimeOver,
+	// catch up with the lines of this frame that were skipped so far.
+	// RTOFlags accumulate down the screen, so the last line passed is enough.
+	PPU.OBJRangeRead = TRUE;
+
+	if (IPPU.RenderThisFrame)
+		return;
+
+	int	C = CPU.V_Counter - FIRST_VISIBLE_LINE;
+	if (CPU.Cycles < Timings.RenderPos)
+		C--;
+	if (C < 0)
+		return;
+	if (C > PPU.ScreenHeight - 1)
+		C = PPU.ScreenHeight - 1;	// vblank, the whole screen was passed
+
+	if (IPPU.OBJChanged || IPPU.OBJDirty)
+		SetupOBJ();
+	PPU.RangeTimeOver |= GFX.OBJLines[C].RTOFlags;
+}
+
+static inline void RenderScreen (struct SBG &BG, bool8 sub)
 {
 	uint8	BGActive;
 	int		D;
 
 	if (!sub)
 	{
-		GFX.S = GFX.Screen;
+		BG.S = GFX.Screen;
 		if (GFX.DoInterlace && GFX.InterlaceFrame)
-			GFX.S += GFX.RealPPL;
-		GFX.DB = GFX.ZBuffer;
-		GFX.Clip = IPPU.Clip[0];
+			BG.S += GFX.RealPPL;
+		BG.DB = GFX.ZBuffer;
+		BG.Clip = IPPU.Clip[0];
 		BGActive = Memory.FillRAM[0x212c] & ~Settings.BG_Forced;
 		D = 32;
 	}
 	else
 	{
-		GFX.S = GFX.SubScreen;
-		GFX.DB = GFX.SubZBuffer;
-		GFX.Clip = IPPU.Clip[1];
+		BG.S = GFX.SubScreen;
+		BG.DB = GFX.SubZBuffer;
+		BG.Clip = IPPU.Clip[1];
 		BGActive = Memory.FillRAM[0x212d] & ~Settings.BG_Forced;
 		D = (Memory.FillRAM[0x2130] & 2) << 4; // 'do math' depth flag
 	}
@@ -346,13 +568,13 @@ static inline void RenderScreen (bool8 sub)
 		BG.NameSelect = PPU.OBJNameSelect;
 		BG.EnableMath = !sub && (Memory.FillRAM[0x2131] & 0x10);
 		BG.StartPalette = 128;
-		S9xSelectTileConverter(4, FALSE, sub, FALSE);
-		S9xSelectTileRenderers(PPU.BGMode, sub, TRUE);
-		DrawOBJS(D + 4);
+		S9xSelectTileConverter(BG, 4, FALSE, sub, FALSE);
+		S9xSelectTileRenderers(BG, PPU.BGMode, sub, TRUE);
+		DrawOBJS(BG, D + 4);
 	}
 
 	BG.NameSelect = 0;
-	S9xSelectTileRenderers(PPU.BGMode, sub, FALSE);
+	S9xSelectTileRenderers(BG, PPU.BGMode, sub, FALSE);
 
 	#define DO_BG(n, pal, depth, hires, offset, Zh, Zl, voffoff) \
 		if (BGActive & (1 << n)) \
@@ -361,7 +583,7 @@ static inline void RenderScreen (bool8 sub)
 			BG.EnableMath = !sub && (Memory.FillRAM[0x2131] & (1 << n)); \
 			BG.TileSizeH = (!hires && PPU.BG[n].BGSize) ? 16 : 8; \
 			BG.TileSizeV = (PPU.BG[n].BGSize) ? 16 : 8; \
-			S9xSelectTileConverter(depth, hires, sub, PPU.BGMosaic[n]); \
+			S9xSelectTileConverter(BG, depth, hires, sub, PPU.BGMosaic[n]); \
 			\
 			if (offset) \
 			{ \
@@ -369,16 +591,16 @@ static inline void RenderScreen (bool8 sub)
 				BG.OffsetSizeV = (PPU.BG[2].BGSize) ? 16 : 8; \
 				\
 				if (PPU.BGMosaic[n] && (hires || PPU.Mosaic > 1)) \
-					DrawBackgroundOffsetMosaic(n, D + Zh, D + Zl, voffoff); \
+					DrawBackgroundOffsetMosaic(BG, n, D + Zh, D + Zl, voffoff); \
 				else \
-					DrawBackgroundOffset(n, D + Zh, D + Zl, voffoff); \
+					DrawBackgroundOffset(BG, n, D + Zh, D + Zl, voffoff); \
 			} \
 			else \
 			{ \
 				if (PPU.BGMosaic[n] && (hires || PPU.Mosaic > 1)) \
-					DrawBackgroundMosaic(n, D + Zh, D + Zl); \
+					DrawBackgroundMosaic(BG, n, D + Zh, D + Zl); \
 				else \
-					DrawBackground(n, D + Zh, D + Zl); \
+					DrawBackground(BG, n, D + Zh, D + Zl); \
 			} \
 		}
 
@@ -425,13 +647,13 @@ static inline void RenderScreen (bool8 sub)
 			if (BGActive & 0x01)
 			{
 				BG.EnableMath = !sub && (Memory.FillRAM[0x2131] & 1);
-				DrawBackgroundMode7(0, GFX.DrawMode7BG1Math, GFX.DrawMode7BG1Nomath, D);
+				DrawBackgroundMode7(BG, 0, BG.DrawMode7BG1Math, BG.DrawMode7BG1Nomath, D);
 			}
 
 			if ((Memory.FillRAM[0x2133] & 0x40) && (BGActive & 0x02))
 			{
 				BG.EnableMath = !sub && (Memory.FillRAM[0x2131] & 2);
-				DrawBackgroundMode7(1, GFX.DrawMode7BG2Math, GFX.DrawMode7BG2Nomath, D);
+				DrawBackgroundMode7(BG, 1, BG.DrawMode7BG2Math, BG.DrawMode7BG2Nomath, D);
 			}
 
 			break;
@@ -441,20 +663,166 @@ static inline void RenderScreen (bool8 sub)
 
 	BG.EnableMath = !sub && (Memory.FillRAM[0x2131] & 0x20);
 
-	DrawBackdrop();
+	DrawBackdrop(BG);
+}
+
+static void RenderLines (struct SBG &BG, uint32 StartY, uint32 EndY, bool8 sub)
+{
+	BG.StartY = StartY;
+	BG.EndY = EndY;
+
+	if (sub)
+		RenderScreen(BG, TRUE);
+
+	RenderScreen(BG, FALSE);
+
+	if (BG.DeferredMath)
+		S9xComposeMath(BG);
+
+	if (!IPPU.DoubleWidthPixels && IPPU.RenderedScreenWidth == SNES_WIDTH << 1)
+		WidenLines(StartY, EndY);
+
+	FinishLines(StartY, EndY);
+}
+
+// Doubles the pixels of lines drawn 256 wide into a frame that is 512 wide
+static void WidenLines (uint32 StartY, uint32 EndY)
+{
+	uint16	*p = GFX.Screen + StartY * GFX.PPL;
+	if (GFX.DoInterlace && GFX.InterlaceFrame)
+		p += GFX.RealPPL;
+
+	for (uint32 y = StartY; y <= EndY; y++, p += GFX.PPL)
+	{
+		for (int x = SNES_WIDTH - 1; x >= 0; x--)
+			p[2 * x] = p[2 * x + 1] = p[x];
+	}
+}
+
+// GFX.Screen32 and the changed rows are brought up to date as each group of
+// lines is drawn, while the lines are still in the cache, rather than in a pass
+// over the whole frame. Rows drawn over later (messages, crosshairs, the switch
+// to hires in mid frame) are finished again just before the frame is shown.
+static void FinishRows (int32 top, int32 bottom)
+{
+	for (int32 r = top; r <= bottom; r++)
+	{
+		uint16	*row = GFX.Screen + r * GFX.RealPPL;
+
+		if (GFX.Screen32)
+			S9xConvertPixels32((uint32 *) ((uint8 *) GFX.Screen32 + r * GFX.Pitch32), row, IPPU.RenderedScreenWidth);
+
+		if (GFX.ShownScreen)
+		{
+			uint16	*shown = GFX.ShownScreen + r * GFX.RealPPL;
+			size_t	size = IPPU.RenderedScreenWidth * sizeof(uint16);
+
+			if (memcmp(shown, row, size))
+			{
+				memcpy(shown, row, size);
+				rows_changed[r] = TRUE;
+			}
+		}
+	}
+}
+
+static void FinishLines (uint32 StartY, uint32 EndY)
+{
+	if (!GFX.Screen32 && !GFX.ShownScreen)
+		return;
+
+	// The rows RenderScreen drew the lines to
+	uint32	step = GFX.PPL / GFX.RealPPL;
+	uint32	row = StartY * step + ((GFX.DoInterlace && GFX.InterlaceFrame) ? 1 : 0);
+
+	for (uint32 y = StartY; y <= EndY; y++, row += step)
+		FinishRows(row, row);
+}
+
+static void MarkRows (int32 top, int32 bottom)
+{
+	if (!GFX.Screen32 && !GFX.ShownScreen)
+		return;
+
+	if (top < 0)
+		top = 0;
+	if (bottom >= IPPU.RenderedScreenHeight)
+		bottom = IPPU.RenderedScreenHeight - 1;
+	if (top > bottom)
+		return;
+
+	if (redo_top > redo_bottom)
+	{
+		redo_top = top;
+		redo_bottom = bottom;
+	}
+	else
+	{
+		if (top < redo_top)
+			redo_top = top;
+		if (bottom > redo_bottom)
+			redo_bottom = bottom;
+	}
+}
+
+static void FlushRows (void)
+{
+	if (redo_top <= redo_bottom)
+		FinishRows(redo_top, redo_bottom);
+
+	redo_top = 0;
+	redo_bottom = -1;
+
+	// A frame of another size has nothing in common with the last one
+	if (GFX.ShownScreen && (IPPU.RenderedScreenWidth != shown_width || IPPU.RenderedScreenHeight != shown_height))
+	{
+		memset(rows_changed, TRUE, sizeof(rows_changed));
+		shown_width  = IPPU.RenderedScreenWidth;
+		shown_height = IPPU.RenderedScreenHeight;
+	}
+}
+
+int S9xGetChangedRows (int row, int *count)
+{
+	int	height = IPPU.RenderedScreenHeight;
+
+	// Without GFX.TrackChangedRows every row counts as changed
+	if (!GFX.ShownScreen)
+	{
+		*count = row < height ? height - row : 0;
+		return (row < height ? row : -1);
+	}
+
+	while (row < height && !rows_changed[row])
+		row++;
+
+	if (row >= height)
+	{
+		*count = 0;
+		return (-1);
+	}
+
+	int	end = row;
+	while (end < height && rows_changed[end])
+		end++;
+
+	*count = end - row;
+	return (row);
 }
 
 void S9xUpdateScreen (void)
 {
-	if (IPPU.OBJChanged || IPPU.InterlaceOBJ)
+	struct SBG	&BG = MainBG;
+
+	if (IPPU.OBJChanged || IPPU.OBJDirty || IPPU.InterlaceOBJ)
 		SetupOBJ();
 
 	// XXX: Check ForceBlank? Or anything else?
-	PPU.RangeTimeOver |= GFX.OBJLines[GFX.EndY].RTOFlags;
+	PPU.RangeTimeOver |= GFX.OBJLines[BG.EndY].RTOFlags;
 
-	GFX.StartY = IPPU.PreviousLine;
-	if ((GFX.EndY = IPPU.CurrentLine - 1) >= PPU.ScreenHeight)
-		GFX.EndY = PPU.ScreenHeight - 1;
+	BG.StartY = IPPU.PreviousLine;
+	if ((BG.EndY = IPPU.CurrentLine - 1) >= PPU.ScreenHeight)
+		BG.EndY = PPU.ScreenHeight - 1;
 
 	if (!PPU.ForcedBlanking)
 	{
@@ -467,6 +835,11 @@ void S9xUpdateScreen (void)
 			PPU.RecomputeClipWindows = FALSE;
 		}
 
+		if (IPPU.VRAMDirty)
+			S9xInvalidateDirtyTiles();
+
+		S9xSetupBGLineCache();
+
 		if (Settings.SupportHiRes)
 		{
 			if (!IPPU.DoubleWidthPixels && (PPU.BGMode == 5 || PPU.BGMode == 6 || IPPU.PseudoHires))
@@ -479,7 +852,7 @@ void S9xUpdateScreen (void)
 					// ignoring the true, larger size of the buffer.
 					GFX.RealPPL = GFX.Pitch >> 1;
 
-					for (int32 y = (int32) GFX.StartY - 1; y >= 0; y--)
+					for (int32 y = (int32) BG.StartY - 1; y >= 0; y--)
 					{
 						uint16	*p = GFX.Screen + y * GFX.PPL     + 255;
 						uint16	*q = GFX.Screen + y * GFX.RealPPL + 510;
@@ -493,7 +866,7 @@ void S9xUpdateScreen (void)
 				else
 				#endif
 				// Have to back out of the regular speed hack
-				for (uint32 y = 0; y < GFX.StartY; y++)
+				for (uint32 y = 0; y < BG.StartY; y++)
 				{
 					uint16	*p = GFX.Screen + y * GFX.PPL + 255;
 					uint16	*q = GFX.Screen + y * GFX.PPL + 510;
@@ -504,6 +877,7 @@ void S9xUpdateScreen (void)
 
 				IPPU.DoubleWidthPixels = TRUE;
 				IPPU.RenderedScreenWidth = 512;
+				MarkRows(0, BG.StartY * (GFX.PPL / GFX.RealPPL) - 1);
 			}
 
 			if (!IPPU.DoubleHeightPixels && IPPU.Interlace && (PPU.BGMode == 5 || PPU.BGMode == 6))
@@ -513,38 +887,112 @@ void S9xUpdateScreen (void)
 				GFX.PPL = GFX.RealPPL << 1;
 				GFX.DoInterlace = 2;
 
-				for (int32 y = (int32) GFX.StartY - 2; y >= 0; y--)
+				for (int32 y = (int32) BG.StartY - 2; y >= 0; y--)
 					memmove(GFX.Screen + (y + 1) * GFX.PPL, GFX.Screen + y * GFX.RealPPL, GFX.PPL * sizeof(uint16));
+
+				MarkRows(0, BG.StartY * 2 - 1);
 			}
 		}
 
 		if ((Memory.FillRAM[0x2130] & 0x30) != 0x30 && (Memory.FillRAM[0x2131] & 0x3f))
-			GFX.FixedColour = BUILD_PIXEL(IPPU.XB[PPU.FixedColourRed], IPPU.XB[PPU.FixedColourGreen], IPPU.XB[PPU.FixedColourBlue]);
-
-		if (PPU.BGMode == 5 || PPU.BGMode == 6 || IPPU.PseudoHires ||
-			((Memory.FillRAM[0x2130] & 0x30) != 0x30 && (Memory.FillRAM[0x2130] & 2) && (Memory.FillRAM[0x2131] & 0x3f) && (Memory.FillRAM[0x212d] & 0x1f)))
-			// If hires (Mode 5/6 or pseudo-hires) or math is to be done
-			// involving the subscreen, then we need to render the subscreen...
-			RenderScreen(TRUE);
-
-		RenderScreen(FALSE);
+			GFX.FixedColour = S9xBuildPixel(IPPU.XB[PPU.FixedColourRed], IPPU.XB[PPU.FixedColourGreen], IPPU.XB[PPU.FixedColourBlue]);
+
+		// If hires (Mode 5/6 or pseudo-hires) or math is to be done
+		// involving the subscreen, then we need to render the subscreen...
+		bool8	sub = PPU.BGMode == 5 || PPU.BGMode == 6 || IPPU.PseudoHires ||
+			((Memory.FillRAM[0x2130] & 0x30) != 0x30 && (Memory.FillRAM[0x2130] & 2) && (Memory.FillRAM[0x2131] & 0x3f) && (Memory.FillRAM[0x212d] & 0x1f));
+
+		// Lines without hires in a frame that's already 512 wide are drawn
+		// 256 wide and widened afterwards, rather than every pixel twice.
+		// Interlace draws its tiles differently when wide, so it stays so.
+		bool8	narrow = IPPU.DoubleWidthPixels && !IPPU.Interlace && !(PPU.BGMode == 5 || PPU.BGMode == 6 || IPPU.PseudoHires);
+		if (narrow)
+			IPPU.DoubleWidthPixels = FALSE;
+
+	#ifdef USE_THREADS
+		if (!RenderBandsThreaded(BG.StartY, BG.EndY, sub))
+	#endif
+		RenderLines(BG, BG.StartY, BG.EndY, sub);
+
+		if (narrow)
+			IPPU.DoubleWidthPixels = TRUE;
 	}
 	else
 	{
-		const uint16	black = BUILD_PIXEL(0, 0, 0);
+		const uint16	black = S9xBuildPixel(0, 0, 0);
 
-		GFX.S = GFX.Screen + GFX.StartY * GFX.PPL;
+		BG.S = GFX.Screen + BG.StartY * GFX.PPL;
 		if (GFX.DoInterlace && GFX.InterlaceFrame)
-			GFX.S += GFX.RealPPL;
+			BG.S += GFX.RealPPL;
 
-		for (uint32 l = GFX.StartY; l <= GFX.EndY; l++, GFX.S += GFX.PPL)
+		for (uint32 l = BG.StartY; l <= BG.EndY; l++, BG.S += GFX.PPL)
 			for (int x = 0; x < IPPU.RenderedScreenWidth; x++)
-				GFX.S[x] = black;
+				BG.S[x] = black;
+
+		FinishLines(BG.StartY, BG.EndY);
 	}
 
 	IPPU.PreviousLine = IPPU.CurrentLine;
 }
 
+// What SetupOBJ last worked out in its normal case, so that it can update
+// GFX.OBJLines for just the sprites changed by OAM writes.
+static struct
+{
+	bool8	Valid;
+	int		SpriteLimit;
+	int		MaxTiles;
+	uint8	Top[128];							// first line of each sprite
+	uint8	Rows[128];							// lines drawn, 0 if off screen
+	uint8	VFlip[128];
+	uint8	RTOFlags[SNES_HEIGHT_EXTENDED];		// of the line alone
+}	OBJSetup;
+
+// Sets up the OBJ of one line from scratch, in the same order, and with the
+// same limits, as the sprite by sprite pass of SetupOBJ.
+static void SetupOBJLine (int Y, int sprite_limit, int startline, int inc)
+{
+	uint8	FirstSprite = PPU.FirstSprite;
+	uint8	S = FirstSprite;
+	int		j = 0;
+
+	OBJSetup.RTOFlags[Y] = 0;
+	GFX.OBJLines[Y].Tiles = Settings.MaxSpriteTilesPerLine;
+
+	do
+	{
+		uint8	n = Y - OBJSetup.Top[S];
+
+		if (n < OBJSetup.Rows[S])
+		{
+			if (j >= sprite_limit)
+			{
+				OBJSetup.RTOFlags[Y] |= 0x40;
+				break;
+			}
+
+			GFX.OBJLines[Y].Tiles -= GFX.OBJVisibleTiles[S];
+			if (GFX.OBJLines[Y].Tiles < 0)
+				OBJSetup.RTOFlags[Y] |= 0x80;
+
+			uint8	line = startline + n * inc;
+
+			GFX.OBJLines[Y].OBJ[j].Sprite = S;
+			if (PPU.OBJ[S].VFlip)
+				GFX.OBJLines[Y].OBJ[j].Line = line ^ (GFX.OBJWidths[S] - 1);
+			else
+				GFX.OBJLines[Y].OBJ[j].Line = line;
+
+			j++;
+		}
+
+		S = (S + 1) & 0x7f;
+	} while (S != FirstSprite);
+
+	for (; j < sprite_limit; j++)
+		GFX.OBJLines[Y].OBJ[j].Sprite = -1;
+}
+
 static void SetupOBJ (void)
 {
 	int	SmallWidth, SmallHeight, LargeWidth, LargeHeight;
@@ -607,22 +1055,23 @@ static void SetupOBJ (void)
 
 	if (!PPU.OAMPriorityRotation || !(PPU.OAMFlip & PPU.OAMAddr & 1)) // normal case
 	{
-		uint8	LineOBJ[SNES_HEIGHT_EXTENDED];
-		memset(LineOBJ, 0, sizeof(LineOBJ));
+		// After writes to OAM alone, only the lines of the sprites that moved,
+		// resized, flipped or were cut off differently need setting up again.
+		bool8	full = IPPU.OBJChanged || IPPU.InterlaceOBJ || !OBJSetup.Valid || OBJSetup.SpriteLimit != sprite_limit || OBJSetup.MaxTiles != Settings.MaxSpriteTilesPerLine;
+		bool8	LineDirty[SNES_HEIGHT_EXTENDED];
+		int		dirty_lines = 0;
 
-		for (int i = 0; i < SNES_HEIGHT_EXTENDED; i++)
+		if (!full)
+			memset(LineDirty, 0, sizeof(LineDirty));
+
+		for (S = 0; S < 128; S++)
 		{
-			GFX.OBJLines[i].RTOFlags = 0;
-			GFX.OBJLines[i].Tiles = Settings.MaxSpriteTilesPerLine;
-			for (int j = 0; j < sprite_limit; j++)
-				GFX.OBJLines[i].OBJ[j].Sprite = -1;
-		}
+			if (!full && !(IPPU.OBJDirtySprites[S >> 5] & (1 << (S & 31))))
+				continue;
 
-		uint8	FirstSprite = PPU.FirstSprite;
-		S = FirstSprite;
+			uint8	OldTop = OBJSetup.Top[S], OldRows = OBJSetup.Rows[S];
+			uint8	OldWidth = GFX.OBJWidths[S], OldTiles = GFX.OBJVisibleTiles[S];
 
-		do
-		{
 			if (PPU.OBJ[S].Size)
 			{
 				GFX.OBJWidths[S] = LargeWidth;
@@ -638,6 +1087,9 @@ static void SetupOBJ (void)
 			if (HPos == -256)
 				HPos = 0;
 
+			OBJSetup.Top[S] = (uint8) (PPU.OBJ[S].VPos & 0xff);
+			OBJSetup.Rows[S] = 0;
+
 			if (HPos > -GFX.OBJWidths[S] && HPos <= 256)
 			{
 				if (HPos < 0)
@@ -648,20 +1100,79 @@ static void SetupOBJ (void)
 				else
 					GFX.OBJVisibleTiles[S] = GFX.OBJWidths[S] >> 3;
 
-				for (uint8 line = startline, Y = (uint8) (PPU.OBJ[S].VPos & 0xff); line < Height; Y++, line += inc)
+				OBJSetup.Rows[S] = (Height - startline + inc - 1) / inc;
+			}
+
+			if (full)
+			{
+				OBJSetup.VFlip[S] = PPU.OBJ[S].VFlip;
+				continue;
+			}
+
+			if (OldTop == OBJSetup.Top[S] && OldRows == OBJSetup.Rows[S] && OldWidth == GFX.OBJWidths[S] &&
+				(!OldRows || (OldTiles == GFX.OBJVisibleTiles[S] && OBJSetup.VFlip[S] == PPU.OBJ[S].VFlip)))
+				continue;
+
+			OBJSetup.VFlip[S] = PPU.OBJ[S].VFlip;
+
+			for (uint8 Y = OldTop, n = 0; n < OldRows; Y++, n++)
+			{
+				if (Y < SNES_HEIGHT_EXTENDED && !LineDirty[Y])
+				{
+					LineDirty[Y] = TRUE;
+					dirty_lines++;
+				}
+			}
+
+			for (uint8 Y = OBJSetup.Top[S], n = 0; n < OBJSetup.Rows[S]; Y++, n++)
+			{
+				if (Y < SNES_HEIGHT_EXTENDED && !LineDirty[Y])
+				{
+					LineDirty[Y] = TRUE;
+					dirty_lines++;
+				}
+			}
+		}
+
+		// Rebuilding a line looks at every sprite, so past a point it's cheaper
+		// to go sprite by sprite over all of them.
+		if (dirty_lines > SNES_HEIGHT_EXTENDED / 4)
+			full = TRUE;
+
+		if (full)
+		{
+			uint8	LineOBJ[SNES_HEIGHT_EXTENDED];
+			memset(LineOBJ, 0, sizeof(LineOBJ));
+
+			for (int i = 0; i < SNES_HEIGHT_EXTENDED; i++)
+			{
+				OBJSetup.RTOFlags[i] = 0;
+				GFX.OBJLines[i].Tiles = Settings.MaxSpriteTilesPerLine;
+				for (int j = 0; j < sprite_limit; j++)
+					GFX.OBJLines[i].OBJ[j].Sprite = -1;
+			}
+
+			uint8	FirstSprite = PPU.FirstSprite;
+			S = FirstSprite;
+
+			do
+			{
+				uint8	line = startline, Y = OBJSetup.Top[S];
+
+				for (int n = 0; n < OBJSetup.Rows[S]; Y++, line += inc, n++)
 				{
 					if (Y >= SNES_HEIGHT_EXTENDED)
 						continue;
 
 					if (LineOBJ[Y] >= sprite_limit)
 					{
-						GFX.OBJLines[Y].RTOFlags |= 0x40;
+						OBJSetup.RTOFlags[Y] |= 0x40;
 						continue;
 					}
 
 					GFX.OBJLines[Y].Tiles -= GFX.OBJVisibleTiles[S];
 					if (GFX.OBJLines[Y].Tiles < 0)
-						GFX.OBJLines[Y].RTOFlags |= 0x80;
+						OBJSetup.RTOFlags[Y] |= 0x80;
 
 					GFX.OBJLines[Y].OBJ[LineOBJ[Y]].Sprite = S;
 					if (PPU.OBJ[S].VFlip)
@@ -673,16 +1184,28 @@ static void SetupOBJ (void)
 
 					LineOBJ[Y]++;
 				}
-			}
 
-			S = (S + 1) & 0x7f;
-		} while (S != FirstSprite);
+				S = (S + 1) & 0x7f;
+			} while (S != FirstSprite);
+		}
+		else
+		{
+			for (int Y = 0; Y < SNES_HEIGHT_EXTENDED; Y++)
+				if (LineDirty[Y])
+					SetupOBJLine(Y, sprite_limit, startline, inc);
+		}
+
+		for (int Y = 0; Y < SNES_HEIGHT_EXTENDED; Y++)
+			GFX.OBJLines[Y].RTOFlags = OBJSetup.RTOFlags[Y] | (Y ? GFX.OBJLines[Y - 1].RTOFlags : 0);
 
-		for (int Y = 1; Y < SNES_HEIGHT_EXTENDED; Y++)
-			GFX.OBJLines[Y].RTOFlags |= GFX.OBJLines[Y - 1].RTOFlags;
+		OBJSetup.Valid = TRUE;
+		OBJSetup.SpriteLimit = sprite_limit;
+		OBJSetup.MaxTiles = Settings.MaxSpriteTilesPerLine;
 	}
 	else // evil FirstSprite+Y case
 	{
+		OBJSetup.Valid = FALSE;
+
 		// First, find out which sprites are on which lines
 		uint8 OBJOnLine[SNES_HEIGHT_EXTENDED][128];
 		// memset(OBJOnLine, 0, sizeof(OBJOnLine));
@@ -780,23 +1303,25 @@ static void SetupOBJ (void)
 	}
 
 	IPPU.OBJChanged = FALSE;
+	IPPU.OBJDirty = FALSE;
+	memset(IPPU.OBJDirtySprites, 0, sizeof(IPPU.OBJDirtySprites));
 }
 
 #if defined(__GNUC__) && !defined(__clang__)
 #pragma GCC push_options
 #pragma GCC optimize ("no-tree-vrp")
 #endif
-static void DrawOBJS (int D)
+static void DrawOBJS (struct SBG &BG, int D)
 {
-	void (*DrawTile) (uint32, uint32, uint32, uint32) = NULL;
-	void (*DrawClippedTile) (uint32, uint32, uint32, uint32, uint32, uint32) = NULL;
+	void (*DrawTile) (struct SBG &, uint32, uint32, uint32, uint32) = NULL;
+	void (*DrawClippedTile) (struct SBG &, uint32, uint32, uint32, uint32, uint32, uint32) = NULL;
 
 	int	PixWidth = IPPU.DoubleWidthPixels ? 2 : 1;
 	BG.InterlaceLine = GFX.InterlaceFrame ? 8 : 0;
-	GFX.Z1 = 2;
+	BG.Z1 = 2;
 	int sprite_limit = (Settings.MaxSpriteTilesPerLine == 128) ? 128 : 32;
 	
-	for (uint32 Y = GFX.StartY, Offset = Y * GFX.PPL; Y <= GFX.EndY; Y++, Offset += GFX.PPL)
+	for (uint32 Y = BG.StartY, Offset = Y * GFX.PPL; Y <= BG.EndY; Y++, Offset += GFX.PPL)
 	{
 		int	I = 0;
 		int	tiles = GFX.OBJLines[Y].Tiles;
@@ -819,7 +1344,7 @@ static void DrawOBJS (int D)
 				TileInc = -1;
 			}
 
-			GFX.Z2 = D + PPU.OBJ[S].Priority * 4;
+			BG.Z2 = D + PPU.OBJ[S].Priority * 4;
 
 			int	DrawMode = 3;
 			int	clip = 0, next_clip = -1000;
@@ -836,27 +1361,27 @@ static void DrawOBJS (int D)
 				{
 					if (x >= next_clip)
 					{
-						for (; clip < GFX.Clip[4].Count && GFX.Clip[4].Left[clip] <= x; clip++) ;
-						if (clip == 0 || x >= GFX.Clip[4].Right[clip - 1])
+						for (; clip < BG.Clip[4].Count && BG.Clip[4].Left[clip] <= x; clip++) ;
+						if (clip == 0 || x >= BG.Clip[4].Right[clip - 1])
 						{
 							DrawMode = 0;
-							next_clip = ((clip < GFX.Clip[4].Count) ? GFX.Clip[4].Left[clip] : 1000);
+							next_clip = ((clip < BG.Clip[4].Count) ? BG.Clip[4].Left[clip] : 1000);
 						}
 						else
 						{
-							DrawMode = GFX.Clip[4].DrawMode[clip - 1];
-							next_clip = GFX.Clip[4].Right[clip - 1];
-							GFX.ClipColors = !(DrawMode & 1);
+							DrawMode = BG.Clip[4].DrawMode[clip - 1];
+							next_clip = BG.Clip[4].Right[clip - 1];
+							BG.ClipColors = !(DrawMode & 1);
 
 							if (BG.EnableMath && (PPU.OBJ[S].Palette & 4) && (DrawMode & 2))
 							{
-								DrawTile = GFX.DrawTileMath;
-								DrawClippedTile = GFX.DrawClippedTileMath;
+								DrawTile = BG.DrawTileMath;
+								DrawClippedTile = BG.DrawClippedTileMath;
 							}
 							else
 							{
-								DrawTile = GFX.DrawTileNomath;
-								DrawClippedTile = GFX.DrawClippedTileNomath;
+								DrawTile = BG.DrawTileNomath;
+								DrawClippedTile = BG.DrawClippedTileNomath;
 							}
 						}
 					}
@@ -864,14 +1389,14 @@ static void DrawOBJS (int D)
 					if (x == X && x + 8 < next_clip)
 					{
 						if (DrawMode)
-							DrawTile(BaseTile | TileX, O, TileLine, 1);
+							DrawTile(BG, BaseTile | TileX, O, TileLine, 1);
 						x += 8;
 					}
 					else
 					{
 						int	w = (next_clip <= X + 8) ? next_clip - x : X + 8 - x;
 						if (DrawMode)
-							DrawClippedTile(BaseTile | TileX, O, x - X, w, TileLine, 1);
+							DrawClippedTile(BG, BaseTile | TileX, O, x - X, w, TileLine, 1);
 						x += w;
 					}
 				}
@@ -883,224 +1408,39 @@ static void DrawOBJS (int D)
 #pragma GCC pop_options
 #endif
 
-static void DrawBackground (int bg, uint8 Zh, uint8 Zl)
+static void DrawBackground (struct SBG &BG, int bg, uint8 Zh, uint8 Zl)
 {
 	BG.TileAddress = PPU.BG[bg].NameBase << 1;
 
-	uint32	Tile;
-	uint16	*SC0, *SC1, *SC2, *SC3;
-
-	SC0 = (uint16 *) &Memory.VRAM[PPU.BG[bg].SCBase << 1];
-	SC1 = (PPU.BG[bg].SCSize & 1) ? SC0 + 1024 : SC0;
-	if (SC1 >= (uint16 *) (Memory.VRAM + 0x10000))
-		SC1 -= 0x8000;
-	SC2 = (PPU.BG[bg].SCSize & 2) ? SC1 + 1024 : SC0;
-	if (SC2 >= (uint16 *) (Memory.VRAM + 0x10000))
-		SC2 -= 0x8000;
-	SC3 = (PPU.BG[bg].SCSize & 1) ? SC2 + 1024 : SC2;
-	if (SC3 >= (uint16 *) (Memory.VRAM + 0x10000))
-		SC3 -= 0x8000;
-
-	uint32	Lines;
-	int		OffsetMask  = (BG.TileSizeH == 16) ? 0x3ff : 0x1ff;
-	int		OffsetShift = (BG.TileSizeV == 16) ? 4 : 3;
-	int		PixWidth = IPPU.DoubleWidthPixels ? 2 : 1;
-	bool8	HiresInterlace = IPPU.Interlace && IPPU.DoubleWidthPixels;
-
-	void (*DrawTile) (uint32, uint32, uint32, uint32);
-	void (*DrawClippedTile) (uint32, uint32, uint32, uint32, uint32, uint32);
-
-	for (int clip = 0; clip < GFX.Clip[bg].Count; clip++)
+	if (BGLineCache[bg].Enabled)
 	{
-		GFX.ClipColors = !(GFX.Clip[bg].DrawMode[clip] & 1);
-
-		if (BG.EnableMath && (GFX.Clip[bg].DrawMode[clip] & 2))
-		{
-			DrawTile = GFX.DrawTileMath;
-			DrawClippedTile = GFX.DrawClippedTileMath;
-		}
-		else
-		{
-			DrawTile = GFX.DrawTileNomath;
-			DrawClippedTile = GFX.DrawClippedTileNomath;
-		}
+		S9xBuildBGLines(BG, bg);
 
-		for (uint32 Y = GFX.StartY; Y <= GFX.EndY; Y += Lines)
+		for (int clip = 0; clip < BG.Clip[bg].Count; clip++)
 		{
-			uint32	Y2 = HiresInterlace ? Y * 2 + GFX.InterlaceFrame : Y;
-			uint32	VOffset = LineData[Y].BG[bg].VOffset + (HiresInterlace ? 1 : 0);
-			uint32	HOffset = LineData[Y].BG[bg].HOffset;
-			int		VirtAlign = ((Y2 + VOffset) & 7) >> (HiresInterlace ? 1 : 0);
+			BG.ClipColors = !(BG.Clip[bg].DrawMode[clip] & 1);
 
-			for (Lines = 1; Lines < GFX.LinesPerTile - VirtAlign; Lines++)
-			{
-				if ((VOffset != LineData[Y + Lines].BG[bg].VOffset) || (HOffset != LineData[Y + Lines].BG[bg].HOffset))
-					break;
-			}
-
-			if (Y + Lines > GFX.EndY)
-				Lines = GFX.EndY - Y + 1;
-
-			VirtAlign <<= 3;
-
-			uint32	t1, t2;
-			uint32	TilemapRow = (VOffset + Y2) >> OffsetShift;
-			BG.InterlaceLine = ((VOffset + Y2) & 1) << 3;
-
-			if ((VOffset + Y2) & 8)
-			{
-				t1 = 16;
-				t2 = 0;
-			}
+			if (BG.EnableMath && (BG.Clip[bg].DrawMode[clip] & 2))
+				BG.DrawBGLinesMath(BG, bg, Zh, Zl, clip);
 			else
-			{
-				t1 = 0;
-				t2 = 16;
-			}
-
-			uint16	*b1, *b2;
-
-			if (TilemapRow & 0x20)
-			{
-				b1 = SC2;
-				b2 = SC3;
-			}
-			else
-			{
-				b1 = SC0;
-				b2 = SC1;
-			}
-
-			b1 += (TilemapRow & 0x1f) << 5;
-			b2 += (TilemapRow & 0x1f) << 5;
-
-			uint32	Left   = GFX.Clip[bg].Left[clip];
-			uint32	Right  = GFX.Clip[bg].Right[clip];
-			uint32	Offset = Left * PixWidth + Y * GFX.PPL;
-			uint32	HPos   = (HOffset + Left) & OffsetMask;
-			uint32	HTile  = HPos >> 3;
-			uint16	*t;
-
-			if (BG.TileSizeH == 8)
-			{
-				if (HTile > 31)
-					t = b2 + (HTile & 0x1f);
-				else
-					t = b1 + HTile;
-			}
-			else
-			{
-				if (HTile > 63)
-					t = b2 + ((HTile >> 1) & 0x1f);
-				else
-					t = b1 + (HTile >> 1);
-			}
-
-			uint32	Width = Right - Left;
-
-			if (HPos & 7)
-			{
-				uint32	l = HPos & 7;
-				uint32	w = 8 - l;
-				if (w > Width)
-					w = Width;
-
-				Offset -= l * PixWidth;
-				Tile = READ_WORD(t);
-				GFX.Z1 = GFX.Z2 = (Tile & 0x2000) ? Zh : Zl;
-
-				if (BG.TileSizeV == 16)
-					Tile = TILE_PLUS(Tile, ((Tile & V_FLIP) ? t2 : t1));
-
-				if (BG.TileSizeH == 8)
-				{
-					DrawClippedTile(Tile, Offset, l, w, VirtAlign, Lines);
-					t++;
-					if (HTile == 31)
-						t = b2;
-					else
-					if (HTile == 63)
-						t = b1;
-				}
-				else
-				{
-					if (!(Tile & H_FLIP))
-						DrawClippedTile(TILE_PLUS(Tile, (HTile & 1)), Offset, l, w, VirtAlign, Lines);
-					else
-						DrawClippedTile(TILE_PLUS(Tile, 1 - (HTile & 1)), Offset, l, w, VirtAlign, Lines);
-					t += HTile & 1;
-					if (HTile == 63)
-						t = b2;
-					else
-					if (HTile == 127)
-						t = b1;
-				}
-
-				HTile++;
-				Offset += 8 * PixWidth;
-				Width -= w;
-			}
-
-			while (Width >= 8)
-			{
-				Tile = READ_WORD(t);
-				GFX.Z1 = GFX.Z2 = (Tile & 0x2000) ? Zh : Zl;
-
-				if (BG.TileSizeV == 16)
-					Tile = TILE_PLUS(Tile, ((Tile & V_FLIP) ? t2 : t1));
-
-				if (BG.TileSizeH == 8)
-				{
-					DrawTile(Tile, Offset, VirtAlign, Lines);
-					t++;
-					if (HTile == 31)
-						t = b2;
-					else
-					if (HTile == 63)
-						t = b1;
-				}
-				else
-				{
-					if (!(Tile & H_FLIP))
-						DrawTile(TILE_PLUS(Tile, (HTile & 1)), Offset, VirtAlign, Lines);
-					else
-						DrawTile(TILE_PLUS(Tile, 1 - (HTile & 1)), Offset, VirtAlign, Lines);
-					t += HTile & 1;
-					if (HTile == 63)
-						t = b2;
-					else
-					if (HTile == 127)
-						t = b1;
-				}
-
-				HTile++;
-				Offset += 8 * PixWidth;
-				Width -= 8;
-			}
+				BG.DrawBGLinesNomath(BG, bg, Zh, Zl, clip);
+		}
 
-			if (Width)
-			{
-				Tile = READ_WORD(t);
-				GFX.Z1 = GFX.Z2 = (Tile & 0x2000) ? Zh : Zl;
+		return;
+	}
 
-				if (BG.TileSizeV == 16)
-					Tile = TILE_PLUS(Tile, ((Tile & V_FLIP) ? t2 : t1));
+	for (int clip = 0; clip < BG.Clip[bg].Count; clip++)
+	{
+		BG.ClipColors = !(BG.Clip[bg].DrawMode[clip] & 1);
 
-				if (BG.TileSizeH == 8)
-					DrawClippedTile(Tile, Offset, 0, Width, VirtAlign, Lines);
-				else
-				{
-					if (!(Tile & H_FLIP))
-						DrawClippedTile(TILE_PLUS(Tile, (HTile & 1)), Offset, 0, Width, VirtAlign, Lines);
-					else
-						DrawClippedTile(TILE_PLUS(Tile, 1 - (HTile & 1)), Offset, 0, Width, VirtAlign, Lines);
-				}
-			}
-		}
+		if (BG.EnableMath && (BG.Clip[bg].DrawMode[clip] & 2))
+			BG.DrawBackgroundMath(BG, bg, Zh, Zl, clip);
+		else
+			BG.DrawBackgroundNomath(BG, bg, Zh, Zl, clip);
 	}
 }
 
-static void DrawBackgroundMosaic (int bg, uint8 Zh, uint8 Zl)
+static void DrawBackgroundMosaic (struct SBG &BG, int bg, uint8 Zh, uint8 Zl)
 {
 	BG.TileAddress = PPU.BG[bg].NameBase << 1;
 
@@ -1124,28 +1464,28 @@ static void DrawBackgroundMosaic (int bg, uint8 Zh, uint8 Zl)
 	int	PixWidth = IPPU.DoubleWidthPixels ? 2 : 1;
 	bool8	HiresInterlace = IPPU.Interlace && IPPU.DoubleWidthPixels;
 
-	void (*DrawPix) (uint32, uint32, uint32, uint32, uint32, uint32);
+	void (*DrawPix) (struct SBG &, uint32, uint32, uint32, uint32, uint32, uint32);
 
-	int	MosaicStart = ((uint32) GFX.StartY - PPU.MosaicStart) % PPU.Mosaic;
+	int	MosaicStart = ((uint32) BG.StartY - PPU.MosaicStart) % PPU.Mosaic;
 
-	for (int clip = 0; clip < GFX.Clip[bg].Count; clip++)
+	for (int clip = 0; clip < BG.Clip[bg].Count; clip++)
 	{
-		GFX.ClipColors = !(GFX.Clip[bg].DrawMode[clip] & 1);
+		BG.ClipColors = !(BG.Clip[bg].DrawMode[clip] & 1);
 
-		if (BG.EnableMath && (GFX.Clip[bg].DrawMode[clip] & 2))
-			DrawPix = GFX.DrawMosaicPixelMath;
+		if (BG.EnableMath && (BG.Clip[bg].DrawMode[clip] & 2))
+			DrawPix = BG.DrawMosaicPixelMath;
 		else
-			DrawPix = GFX.DrawMosaicPixelNomath;
+			DrawPix = BG.DrawMosaicPixelNomath;
 
-		for (uint32 Y = GFX.StartY - MosaicStart; Y <= GFX.EndY; Y += PPU.Mosaic)
+		for (uint32 Y = BG.StartY - MosaicStart; Y <= BG.EndY; Y += PPU.Mosaic)
 		{
 			uint32	Y2 = HiresInterlace ? Y * 2 : Y;
 			uint32	VOffset = LineData[Y + MosaicStart].BG[bg].VOffset + (HiresInterlace ? 1 : 0);
 			uint32	HOffset = LineData[Y + MosaicStart].BG[bg].HOffset;
 
 			Lines = PPU.Mosaic - MosaicStart;
-			if (Y + MosaicStart + Lines > GFX.EndY)
-				Lines = GFX.EndY - Y - MosaicStart + 1;
+			if (Y + MosaicStart + Lines > BG.EndY)
+				Lines = BG.EndY - Y - MosaicStart + 1;
 
 			int	VirtAlign = (((Y2 + VOffset) & 7) >> (HiresInterlace ? 1 : 0)) << 3;
 
@@ -1180,8 +1520,8 @@ static void DrawBackgroundMosaic (int bg, uint8 Zh, uint8 Zl)
 			b1 += (TilemapRow & 0x1f) << 5;
 			b2 += (TilemapRow & 0x1f) << 5;
 
-			uint32	Left   = GFX.Clip[bg].Left[clip];
-			uint32	Right  = GFX.Clip[bg].Right[clip];
+			uint32	Left   = BG.Clip[bg].Left[clip];
+			uint32	Right  = BG.Clip[bg].Right[clip];
 			uint32	Offset = Left * PixWidth + (Y + MosaicStart) * GFX.PPL;
 			uint32	HPos   = (HOffset + Left - (Left % PPU.Mosaic)) & OffsetMask;
 			uint32	HTile  = HPos >> 3;
@@ -1213,19 +1553,19 @@ static void DrawBackgroundMosaic (int bg, uint8 Zh, uint8 Zl)
 					w = Width;
 
 				Tile = READ_WORD(t);
-				GFX.Z1 = GFX.Z2 = (Tile & 0x2000) ? Zh : Zl;
+				BG.Z1 = BG.Z2 = (Tile & 0x2000) ? Zh : Zl;
 
 				if (BG.TileSizeV == 16)
 					Tile = TILE_PLUS(Tile, ((Tile & V_FLIP) ? t2 : t1));
 
 				if (BG.TileSizeH == 8)
-					DrawPix(Tile, Offset, VirtAlign, HPos & 7, w, Lines);
+					DrawPix(BG, Tile, Offset, VirtAlign, HPos & 7, w, Lines);
 				else
 				{
 					if (!(Tile & H_FLIP))
-						DrawPix(TILE_PLUS(Tile, (HTile & 1)), Offset, VirtAlign, HPos & 7, w, Lines);
+						DrawPix(BG, TILE_PLUS(Tile, (HTile & 1)), Offset, VirtAlign, HPos & 7, w, Lines);
 					else
-						DrawPix(TILE_PLUS(Tile, 1 - (HTile & 1)), Offset, VirtAlign, HPos & 7, w, Lines);
+						DrawPix(BG, TILE_PLUS(Tile, 1 - (HTile & 1)), Offset, VirtAlign, HPos & 7, w, Lines);
 				}
 
 				HPos += PPU.Mosaic;
@@ -1266,7 +1606,7 @@ static void DrawBackgroundMosaic (int bg, uint8 Zh, uint8 Zl)
 	}
 }
 
-static void DrawBackgroundOffset (int bg, uint8 Zh, uint8 Zl, int VOffOff)
+static void DrawBackgroundOffset (struct SBG &BG, int bg, uint8 Zh, uint8 Zl, int VOffOff)
 {
 	BG.TileAddress = PPU.BG[bg].NameBase << 1;
 
@@ -1304,22 +1644,22 @@ static void DrawBackgroundOffset (int bg, uint8 Zh, uint8 Zl, int VOffOff)
 	int	PixWidth = IPPU.DoubleWidthPixels ? 2 : 1;
 	bool8	HiresInterlace = IPPU.Interlace && IPPU.DoubleWidthPixels;
 
-	void (*DrawClippedTile) (uint32, uint32, uint32, uint32, uint32, uint32);
+	void (*DrawClippedTile) (struct SBG &, uint32, uint32, uint32, uint32, uint32, uint32);
 
-	for (int clip = 0; clip < GFX.Clip[bg].Count; clip++)
+	for (int clip = 0; clip < BG.Clip[bg].Count; clip++)
 	{
-		GFX.ClipColors = !(GFX.Clip[bg].DrawMode[clip] & 1);
+		BG.ClipColors = !(BG.Clip[bg].DrawMode[clip] & 1);
 
-		if (BG.EnableMath && (GFX.Clip[bg].DrawMode[clip] & 2))
+		if (BG.EnableMath && (BG.Clip[bg].DrawMode[clip] & 2))
 		{
-			DrawClippedTile = GFX.DrawClippedTileMath;
+			DrawClippedTile = BG.DrawClippedTileMath;
 		}
 		else
 		{
-			DrawClippedTile = GFX.DrawClippedTileNomath;
+			DrawClippedTile = BG.DrawClippedTileNomath;
 		}
 
-		for (uint32 Y = GFX.StartY; Y <= GFX.EndY; Y++)
+		for (uint32 Y = BG.StartY; Y <= BG.EndY; Y++)
 		{
 			uint32	Y2 = HiresInterlace ? Y * 2 + GFX.InterlaceFrame : Y;
 			uint32	VOff = LineData[Y].BG[2].VOffset - 1;
@@ -1344,8 +1684,8 @@ static void DrawBackgroundOffset (int bg, uint8 Zh, uint8 Zl, int VOffOff)
 			s = ((VOffsetRow & 0x20) ? BPS2 : BPS0) + ((VOffsetRow & 0x1f) << 5);
 			int32	VOffsetOffset = s - s1;
 
-			uint32	Left  = GFX.Clip[bg].Left[clip];
-			uint32	Right = GFX.Clip[bg].Right[clip];
+			uint32	Left  = BG.Clip[bg].Left[clip];
+			uint32	Right = BG.Clip[bg].Right[clip];
 			uint32	Offset = Left * PixWidth + Y * GFX.PPL;
 			uint32	HScroll = LineData[Y].BG[bg].HOffset;
 			bool8	left_edge = (Left < (8 - (HScroll & 7)));
@@ -1469,21 +1809,21 @@ static void DrawBackgroundOffset (int bg, uint8 Zh, uint8 Zl, int VOffOff)
 
 				Offset -= l * PixWidth;
 				Tile = READ_WORD(t);
-				GFX.Z1 = GFX.Z2 = (Tile & 0x2000) ? Zh : Zl;
+				BG.Z1 = BG.Z2 = (Tile & 0x2000) ? Zh : Zl;
 
 				if (BG.TileSizeV == 16)
 					Tile = TILE_PLUS(Tile, ((Tile & V_FLIP) ? t2 : t1));
 
 				if (BG.TileSizeH == 8)
 				{
-					DrawClippedTile(Tile, Offset, l, w, VirtAlign, 1);
+					DrawClippedTile(BG, Tile, Offset, l, w, VirtAlign, 1);
 				}
 				else
 				{
 					if (!(Tile & H_FLIP))
-						DrawClippedTile(TILE_PLUS(Tile, (HTile & 1)), Offset, l, w, VirtAlign, 1);
+						DrawClippedTile(BG, TILE_PLUS(Tile, (HTile & 1)), Offset, l, w, VirtAlign, 1);
 					else
-						DrawClippedTile(TILE_PLUS(Tile, 1 - (HTile & 1)), Offset, l, w, VirtAlign, 1);
+						DrawClippedTile(BG, TILE_PLUS(Tile, 1 - (HTile & 1)), Offset, l, w, VirtAlign, 1);
 				}
 
 				Left += w;
@@ -1494,7 +1834,7 @@ static void DrawBackgroundOffset (int bg, uint8 Zh, uint8 Zl, int VOffOff)
 	}
 }
 
-static void DrawBackgroundOffsetMosaic (int bg, uint8 Zh, uint8 Zl, int VOffOff)
+static void DrawBackgroundOffsetMosaic (struct SBG &BG, int bg, uint8 Zh, uint8 Zl, int VOffOff)
 {
 	BG.TileAddress = PPU.BG[bg].NameBase << 1;
 
@@ -1532,28 +1872,28 @@ static void DrawBackgroundOffsetMosaic (int bg, uint8 Zh, uint8 Zl, int VOffOff)
 	int	PixWidth = IPPU.DoubleWidthPixels ? 2 : 1;
 	bool8	HiresInterlace = IPPU.Interlace && IPPU.DoubleWidthPixels;
 
-	void (*DrawPix) (uint32, uint32, uint32, uint32, uint32, uint32);
+	void (*DrawPix) (struct SBG &, uint32, uint32, uint32, uint32, uint32, uint32);
 
-	int	MosaicStart = ((uint32) GFX.StartY - PPU.MosaicStart) % PPU.Mosaic;
+	int	MosaicStart = ((uint32) BG.StartY - PPU.MosaicStart) % PPU.Mosaic;
 
-	for (int clip = 0; clip < GFX.Clip[bg].Count; clip++)
+	for (int clip = 0; clip < BG.Clip[bg].Count; clip++)
 	{
-		GFX.ClipColors = !(GFX.Clip[bg].DrawMode[clip] & 1);
+		BG.ClipColors = !(BG.Clip[bg].DrawMode[clip] & 1);
 
-		if (BG.EnableMath && (GFX.Clip[bg].DrawMode[clip] & 2))
-			DrawPix = GFX.DrawMosaicPixelMath;
+		if (BG.EnableMath && (BG.Clip[bg].DrawMode[clip] & 2))
+			DrawPix = BG.DrawMosaicPixelMath;
 		else
-			DrawPix = GFX.DrawMosaicPixelNomath;
+			DrawPix = BG.DrawMosaicPixelNomath;
 
-		for (uint32 Y = GFX.StartY - MosaicStart; Y <= GFX.EndY; Y += PPU.Mosaic)
+		for (uint32 Y = BG.StartY - MosaicStart; Y <= BG.EndY; Y += PPU.Mosaic)
 		{
 			uint32	Y2 = HiresInterlace ? Y * 2 : Y;
 			uint32	VOff = LineData[Y + MosaicStart].BG[2].VOffset - 1;
 			uint32	HOff = LineData[Y + MosaicStart].BG[2].HOffset;
 
 			Lines = PPU.Mosaic - MosaicStart;
-			if (Y + MosaicStart + Lines > GFX.EndY)
-				Lines = GFX.EndY - Y - MosaicStart + 1;
+			if (Y + MosaicStart + Lines > BG.EndY)
+				Lines = BG.EndY - Y - MosaicStart + 1;
 
 			uint32	HOffsetRow = VOff >> Offset2Shift;
 			uint32	VOffsetRow = (VOff + VOffOff) >> Offset2Shift;
@@ -1575,8 +1915,8 @@ static void DrawBackgroundOffsetMosaic (int bg, uint8 Zh, uint8 Zl, int VOffOff)
 			s = ((VOffsetRow & 0x20) ? BPS2 : BPS0) + ((VOffsetRow & 0x1f) << 5);
 			int32	VOffsetOffset = s - s1;
 
-			uint32	Left =  GFX.Clip[bg].Left[clip];
-			uint32	Right = GFX.Clip[bg].Right[clip];
+			uint32	Left =  BG.Clip[bg].Left[clip];
+			uint32	Right = BG.Clip[bg].Right[clip];
 			uint32	Offset = Left * PixWidth + (Y + MosaicStart) * GFX.PPL;
 			uint32	HScroll = LineData[Y + MosaicStart].BG[bg].HOffset;
 			uint32	Width = Right - Left;
@@ -1696,20 +2036,20 @@ static void DrawBackgroundOffsetMosaic (int bg, uint8 Zh, uint8 Zl, int VOffOff)
 					w = Width;
 
 				Tile = READ_WORD(t);
-				GFX.Z1 = GFX.Z2 = (Tile & 0x2000) ? Zh : Zl;
+				BG.Z1 = BG.Z2 = (Tile & 0x2000) ? Zh : Zl;
 
 				if (BG.TileSizeV == 16)
 					Tile = TILE_PLUS(Tile, ((Tile & V_FLIP) ? t2 : t1));
 
 				if (BG.TileSizeH == 8)
-					DrawPix(Tile, Offset, VirtAlign, HPos & 7, w, Lines);
+					DrawPix(BG, Tile, Offset, VirtAlign, HPos & 7, w, Lines);
 				else
 				{
 					if (!(Tile & H_FLIP))
-						DrawPix(TILE_PLUS(Tile, (HTile & 1)), Offset, VirtAlign, HPos & 7, w, Lines);
+						DrawPix(BG, TILE_PLUS(Tile, (HTile & 1)), Offset, VirtAlign, HPos & 7, w, Lines);
 					else
 					if (!(Tile & V_FLIP))
-						DrawPix(TILE_PLUS(Tile, 1 - (HTile & 1)), Offset, VirtAlign, HPos & 7, w, Lines);
+						DrawPix(BG, TILE_PLUS(Tile, 1 - (HTile & 1)), Offset, VirtAlign, HPos & 7, w, Lines);
 				}
 
 				Left += w;
@@ -1722,31 +2062,31 @@ static void DrawBackgroundOffsetMosaic (int bg, uint8 Zh, uint8 Zl, int VOffOff)
 	}
 }
 
-static inline void DrawBackgroundMode7 (int bg, void (*DrawMath) (uint32, uint32, int), void (*DrawNomath) (uint32, uint32, int), int D)
+static inline void DrawBackgroundMode7 (struct SBG &BG, int bg, void (*DrawMath) (struct SBG &, uint32, uint32, int), void (*DrawNomath) (struct SBG &, uint32, uint32, int), int D)
 {
-	for (int clip = 0; clip < GFX.Clip[bg].Count; clip++)
+	for (int clip = 0; clip < BG.Clip[bg].Count; clip++)
 	{
-		GFX.ClipColors = !(GFX.Clip[bg].DrawMode[clip] & 1);
+		BG.ClipColors = !(BG.Clip[bg].DrawMode[clip] & 1);
 
-		if (BG.EnableMath && (GFX.Clip[bg].DrawMode[clip] & 2))
-			DrawMath(GFX.Clip[bg].Left[clip], GFX.Clip[bg].Right[clip], D);
+		if (BG.EnableMath && (BG.Clip[bg].DrawMode[clip] & 2))
+			DrawMath(BG, BG.Clip[bg].Left[clip], BG.Clip[bg].Right[clip], D);
 		else
-			DrawNomath(GFX.Clip[bg].Left[clip], GFX.Clip[bg].Right[clip], D);
+			DrawNomath(BG, BG.Clip[bg].Left[clip], BG.Clip[bg].Right[clip], D);
 	}
 }
 
-static inline void DrawBackdrop (void)
+static inline void DrawBackdrop (struct SBG &BG)
 {
-	uint32	Offset = GFX.StartY * GFX.PPL;
+	uint32	Offset = BG.StartY * GFX.PPL;
 
-	for (int clip = 0; clip < GFX.Clip[5].Count; clip++)
+	for (int clip = 0; clip < BG.Clip[5].Count; clip++)
 	{
-		GFX.ClipColors = !(GFX.Clip[5].DrawMode[clip] & 1);
+		BG.ClipColors = !(BG.Clip[5].DrawMode[clip] & 1);
 
-		if (BG.EnableMath && (GFX.Clip[5].DrawMode[clip] & 2))
-			GFX.DrawBackdropMath(Offset, GFX.Clip[5].Left[clip], GFX.Clip[5].Right[clip]);
+		if (BG.EnableMath && (BG.Clip[5].DrawMode[clip] & 2))
+			BG.DrawBackdropMath(BG, Offset, BG.Clip[5].Left[clip], BG.Clip[5].Right[clip]);
 		else
-			GFX.DrawBackdropNomath(Offset, GFX.Clip[5].Left[clip], GFX.Clip[5].Right[clip]);
+			BG.DrawBackdropNomath(BG, Offset, BG.Clip[5].Left[clip], BG.Clip[5].Right[clip]);
 	}
 }
 
@@ -1770,11 +2110,18 @@ void S9xSetInfoString (const char *string)
 
 void S9xDisplayChar (uint16 *s, uint8 c)
 {
-	const uint16	black = BUILD_PIXEL(0, 0, 0);
+	const uint16	black = S9xBuildPixel(0, 0, 0);
 
 	int	line   = ((c - 32) >> 4) * font_height;
 	int	offset = ((c - 32) & 15) * font_width;
 
+	// Ports may draw text into buffers of their own
+	if (s >= GFX.Screen && s < GFX.Screen + GFX.RealPPL * IPPU.RenderedScreenHeight)
+	{
+		int32	row = (s - GFX.Screen) / GFX.RealPPL;
+		MarkRows(row, row + font_height - 1);
+	}
+
 	for (int h = 0; h < font_height; h++, line++, s += GFX.RealPPL - font_width)
 	{
 		for (int w = 0; w < font_width; w++, s++)
@@ -2070,22 +2417,22 @@ static uint16 get_crosshair_color (uint8 color)
 {
 	switch (color & 15)
 	{
-		case  0: return (BUILD_PIXEL( 0,  0,  0)); // transparent, shouldn't be used
-		case  1: return (BUILD_PIXEL( 0,  0,  0)); // Black
-		case  2: return (BUILD_PIXEL( 8,  8,  8)); // 25Grey
-		case  3: return (BUILD_PIXEL(16, 16, 16)); // 50Grey
-		case  4: return (BUILD_PIXEL(23, 23, 23)); // 75Grey
-		case  5: return (BUILD_PIXEL(31, 31, 31)); // White
-		case  6: return (BUILD_PIXEL(31,  0,  0)); // Red
-		case  7: return (BUILD_PIXEL(31, 16,  0)); // Orange
-		case  8: return (BUILD_PIXEL(31, 31,  0)); // Yellow
-		case  9: return (BUILD_PIXEL( 0, 31,  0)); // Green
-		case 10: return (BUILD_PIXEL( 0, 31, 31)); // Cyan
-		case 11: return (BUILD_PIXEL( 0, 23, 31)); // Sky
-		case 12: return (BUILD_PIXEL( 0,  0, 31)); // Blue
-		case 13: return (BUILD_PIXEL(23,  0, 31)); // Violet
-		case 14: return (BUILD_PIXEL(31,  0, 31)); // Magenta
-		case 15: return (BUILD_PIXEL(31,  0, 16)); // Purple
+		case  0: return (S9xBuildPixel( 0,  0,  0)); // transparent, shouldn't be used
+		case  1: return (S9xBuildPixel( 0,  0,  0)); // Black
+		case  2: return (S9xBuildPixel( 8,  8,  8)); // 25Grey
+		case  3: return (S9xBuildPixel(16, 16, 16)); // 50Grey
+		case  4: return (S9xBuildPixel(23, 23, 23)); // 75Grey
+		case  5: return (S9xBuildPixel(31, 31, 31)); // White
+		case  6: return (S9xBuildPixel(31,  0,  0)); // Red
+		case  7: return (S9xBuildPixel(31, 16,  0)); // Orange
+		case  8: return (S9xBuildPixel(31, 31,  0)); // Yellow
+		case  9: return (S9xBuildPixel( 0, 31,  0)); // Green
+		case 10: return (S9xBuildPixel( 0, 31, 31)); // Cyan
+		case 11: return (S9xBuildPixel( 0, 23, 31)); // Sky
+		case 12: return (S9xBuildPixel( 0,  0, 31)); // Blue
+		case 13: return (S9xBuildPixel(23,  0, 31)); // Violet
+		case 14: return (S9xBuildPixel(31,  0, 31)); // Magenta
+		case 15: return (S9xBuildPixel(31,  0, 16)); // Purple
 	}
 
 	return (0);
@@ -2108,6 +2455,8 @@ void S9xDrawCrosshair (const char *crosshair, uint8 fgcolor, uint8 bgcolor, int1
 	fg = get_crosshair_color(fgcolor);
 	bg = get_crosshair_color(bgcolor);
 
+	MarkRows(y, y + 15 * rx - 1);
+
 	uint16	*s = GFX.Screen + y * (int32)GFX.RealPPL + x;
 
 	for (r = 0; r < 15 * rx; r++, s += GFX.RealPPL - 15 * cx)
@@ -2135,10 +2484,10 @@ void S9xDrawCrosshair (const char *crosshair, uint8 fgcolor, uint8 bgcolor, int1
 			uint8	p = crosshair[(r / rx) * 15 + (c / cx)];
 
 			if (p == '#' && fgcolor)
-				*s = (fgcolor & 0x10) ? COLOR_ADD::fn1_2(fg, *s) : fg;
+				*s = (fgcolor & 0x10) ? (S9xPixelFormat555() ? COLOR_ADD_T<PIXEL_RGB555>::fn1_2(fg, *s) : COLOR_ADD_T<PIXEL_RGB565>::fn1_2(fg, *s)) : fg;
 			else
 			if (p == '.' && bgcolor)
-				*s = (bgcolor & 0x10) ? COLOR_ADD::fn1_2(*s, bg) : bg;
+				*s = (bgcolor & 0x10) ? (S9xPixelFormat555() ? COLOR_ADD_T<PIXEL_RGB555>::fn1_2(*s, bg) : COLOR_ADD_T<PIXEL_RGB565>::fn1_2(*s, bg)) : bg;
 		}
 	}
 }
@@ -15,29 +15,23 @@ struct SGFX
 	uint16	*SubScreen;
 	uint8	*ZBuffer;
 	uint8	*SubZBuffer;
+	uint8	*MathBuffer;		// main screen pixels left for S9xComposeMath
 	uint32	Pitch;
+	uint32	*Screen32;			// XRGB8888 copy of Screen kept by the core, if the port sets it
+	uint32	Pitch32;
+	uint32	PixelFormat;		// 565 or 555, set by the port; 0 for the PIXEL_FORMAT of the build
+	bool8	TrackChangedRows;	// set by the port to have S9xGetChangedRows compare frames
+	uint16	*ShownScreen;		// rows of the last frame shown, kept when TrackChangedRows
 	uint32	ScreenSize;
-	uint16	*S;
-	uint8	*DB;
 	uint16	*ZERO;
 	uint32	RealPPL;			// true PPL of Screen buffer
 	uint32	PPL;				// number of pixels on each of Screen buffer
-	uint32	LinesPerTile;		// number of lines in 1 tile (4 or 8 due to interlace)
-	uint16	*ScreenColors;		// screen colors for rendering main
-	uint16	*RealScreenColors;	// screen colors, ignoring color window clipping
-	uint8	Z1;					// depth for comparison
-	uint8	Z2;					// depth to save
 	uint32	FixedColour;
 	uint8	DoInterlace;
 	uint8	InterlaceFrame;
-	uint32	StartY;
-	uint32	EndY;
-	bool8	ClipColors;
 	uint8	OBJWidths[128];
 	uint8	OBJVisibleTiles[128];
 
-	struct ClipData	*Clip;
-
 	struct
 	{
 		uint8	RTOFlags;
@@ -50,26 +44,47 @@ struct SGFX
 		}	OBJ[128];
 	}	OBJLines[SNES_HEIGHT_EXTENDED];
 
-	void	(*DrawBackdropMath) (uint32, uint32, uint32);
-	void	(*DrawBackdropNomath) (uint32, uint32, uint32);
-	void	(*DrawTileMath) (uint32, uint32, uint32, uint32);
-	void	(*DrawTileNomath) (uint32, uint32, uint32, uint32);
-	void	(*DrawClippedTileMath) (uint32, uint32, uint32, uint32, uint32, uint32);
-	void	(*DrawClippedTileNomath) (uint32, uint32, uint32, uint32, uint32, uint32);
-	void	(*DrawMosaicPixelMath) (uint32, uint32, uint32, uint32, uint32, uint32);
-	void	(*DrawMosaicPixelNomath) (uint32, uint32, uint32, uint32, uint32, uint32);
-	void	(*DrawMode7BG1Math) (uint32, uint32, int);
-	void	(*DrawMode7BG1Nomath) (uint32, uint32, int);
-	void	(*DrawMode7BG2Math) (uint32, uint32, int);
-	void	(*DrawMode7BG2Nomath) (uint32, uint32, int);
-
 	const char	*InfoString;
 	uint32	InfoStringTimeout;
 	char	FrameDisplayString[256];
 };
 
+// State of the layer currently being drawn, passed to each renderer. With
+// Settings.RenderThreads every band of the screen update has its own one and
+// draws lines StartY to EndY of it.
 struct SBG
 {
+	uint16	*S;
+	uint8	*DB;
+	uint32	StartY;
+	uint32	EndY;
+	uint32	LinesPerTile;		// number of lines in 1 tile (4 or 8 due to interlace)
+	uint16	*ScreenColors;		// screen colors for rendering main
+	uint16	*RealScreenColors;	// screen colors, ignoring color window clipping
+	uint8	Z1;					// depth for comparison
+	uint8	Z2;					// depth to save
+	bool8	ClipColors;
+	uint8	DeferredMath;		// color math left for S9xComposeMath, 0 if none
+
+	struct ClipData	*Clip;
+
+	void	(*DrawBackdropMath) (struct SBG &, uint32, uint32, uint32);
+	void	(*DrawBackdropNomath) (struct SBG &, uint32, uint32, uint32);
+	void	(*DrawTileMath) (struct SBG &, uint32, uint32, uint32, uint32);
+	void	(*DrawTileNomath) (struct SBG &, uint32, uint32, uint32, uint32);
+	void	(*DrawClippedTileMath) (struct SBG &, uint32, uint32, uint32, uint32, uint32, uint32);
+	void	(*DrawClippedTileNomath) (struct SBG &, uint32, uint32, uint32, uint32, uint32, uint32);
+	void	(*DrawMosaicPixelMath) (struct SBG &, uint32, uint32, uint32, uint32, uint32, uint32);
+	void	(*DrawMosaicPixelNomath) (struct SBG &, uint32, uint32, uint32, uint32, uint32, uint32);
+	void	(*DrawBackgroundMath) (struct SBG &, uint32, uint8, uint8, uint32);
+	void	(*DrawBackgroundNomath) (struct SBG &, uint32, uint8, uint8, uint32);
+	void	(*DrawBGLinesMath) (struct SBG &, uint32, uint8, uint8, uint32);
+	void	(*DrawBGLinesNomath) (struct SBG &, uint32, uint8, uint8, uint32);
+	void	(*DrawMode7BG1Math) (struct SBG &, uint32, uint32, int);
+	void	(*DrawMode7BG1Nomath) (struct SBG &, uint32, uint32, int);
+	void	(*DrawMode7BG2Math) (struct SBG &, uint32, uint32, int);
+	void	(*DrawMode7BG2Nomath) (struct SBG &, uint32, uint32, int);
+
 	uint8	(*ConvertTile) (uint8 *, uint32, uint32);
 	uint8	(*ConvertTileFlip) (uint8 *, uint32, uint32);
 
@@ -116,93 +131,177 @@ struct SLineMatrixData
 	short	M7VOFS;
 };
 
+// A background layer kept drawn in tilemap space, Width x Height pixels, for
+// Settings.BGLineCache. Each pixel is its index into IPPU.ScreenColors, 0 if
+// transparent, so scrolling and palette changes still find it valid. Rows are
+// drawn the first time a screen line shows them and dropped by
+// S9xInvalidateDirtyTiles when their tilemap entries or the character data of
+// any drawn row is written.
+struct SBGLineCache
+{
+	bool8	Enabled;			// draw the layer from here in this screen update
+	uint8	BGMode;
+	uint16	SCBase;
+	uint8	SCSize;
+	uint8	BGSize;
+	uint16	NameBase;
+	uint32	Width;
+	uint32	Height;
+	uint32	Size;				// pixels allocated
+	uint8	*Pixels;
+	uint8	RowState[1024];		// TRUE once the row is drawn
+	uint32	Opaque[1024][4];	// a bit for every 8 pixels of the row with any pixel drawn
+	uint32	High[1024][4];		// a bit for every 8 pixels of the row from a high priority tile
+	uint32	UsedChars[128];		// a bit for every 16 bytes of character data read
+};
+
 extern uint16		BlackColourMap[256];
+extern struct SBGLineCache	BGLineCache[4];
 extern uint16		DirectColourMaps[8][256];
 extern uint8		mul_brightness[16][32];
 extern uint8		brightness_cap[64];
-extern struct SBG	BG;
 extern struct SGFX	GFX;
 
 #define H_FLIP		0x4000
 #define V_FLIP		0x8000
 #define BLANK_TILE	2
 
-struct COLOR_ADD
+#define TILE_PLUS(t, x)	(((t) & 0xfc00) | ((t + x) & 0x3ff))
+
+// The pixel formats of pixform.h as types, so that the renderer and its color
+// math can be instantiated for each of them. GFX.PixelFormat picks the one used.
+#define PIXEL_FORMAT_TRAITS(F, N) \
+struct PIXEL_##F \
+{ \
+	enum \
+	{ \
+		Format         = N, \
+		MaxRed         = MAX_RED_##F, \
+		MaxGreen       = MAX_GREEN_##F, \
+		MaxBlue        = MAX_BLUE_##F, \
+		RedShift       = RED_SHIFT_BITS_##F, \
+		GreenShift     = GREEN_SHIFT_BITS_##F, \
+		RedHiBit       = RED_HI_BIT_MASK_##F, \
+		GreenHiBit     = GREEN_HI_BIT_MASK_##F, \
+		BlueHiBit      = BLUE_HI_BIT_MASK_##F, \
+		RedMask        = FIRST_COLOR_MASK_##F, \
+		GreenMask      = SECOND_COLOR_MASK_##F, \
+		BlueMask       = THIRD_COLOR_MASK_##F, \
+		AlphaMask      = ALPHA_BITS_MASK_##F, \
+		LowBitsMask    = RED_LOW_BIT_MASK_##F | GREEN_LOW_BIT_MASK_##F | BLUE_LOW_BIT_MASK_##F, \
+		HiBitsMaskx2   = (RED_HI_BIT_MASK_##F | GREEN_HI_BIT_MASK_##F | BLUE_HI_BIT_MASK_##F) << 1 \
+	}; \
+	static alwaysinline uint16 Build (uint32 R, uint32 G, uint32 B) { return (BUILD_PIXEL_##F(R, G, B)); } \
+	static alwaysinline uint16 Build2 (uint32 R, uint32 G, uint32 B) { return (BUILD_PIXEL2_##F(R, G, B)); } \
+	static alwaysinline void Decompose (uint32 Pixel, uint32 &R, uint32 &G, uint32 &B) { DECOMPOSE_PIXEL_##F(Pixel, R, G, B); } \
+};
+
+PIXEL_FORMAT_TRAITS(RGB565, 565)
+PIXEL_FORMAT_TRAITS(RGB555, 555)
+
+#define PIXEL_TRAITS_D(F)	CONCAT(PIXEL_, F)
+typedef PIXEL_TRAITS_D(PIXEL_FORMAT)	PIXEL_BUILD;	// the PIXEL_FORMAT of this build
+
+template<class F>
+struct COLOR_ADD_T
 {
 	static alwaysinline uint16 fn(uint16 C1, uint16 C2)
 	{
-		const int RED_MASK = 0x1F << RED_SHIFT_BITS;
-		const int GREEN_MASK = 0x1F << GREEN_SHIFT_BITS;
+		const int RED_MASK = 0x1F << F::RedShift;
+		const int GREEN_MASK = 0x1F << F::GreenShift;
 		const int BLUE_MASK = 0x1F;
 
 		int rb = C1 & (RED_MASK | BLUE_MASK);
 		rb += C2 & (RED_MASK | BLUE_MASK);
-		int rbcarry = rb & ((0x20 << RED_SHIFT_BITS) | (0x20 << 0));
+		int rbcarry = rb & ((0x20 << F::RedShift) | (0x20 << 0));
 		int g = (C1 & (GREEN_MASK)) + (C2 & (GREEN_MASK));
-		int rgbsaturate = (((g & (0x20 << GREEN_SHIFT_BITS)) | rbcarry) >> 5) * 0x1f;
+		int rgbsaturate = (((g & (0x20 << F::GreenShift)) | rbcarry) >> 5) * 0x1f;
 		uint16 retval = (rb & (RED_MASK | BLUE_MASK)) | (g & GREEN_MASK) | rgbsaturate;
-#if GREEN_SHIFT_BITS == 6
-		retval |= (retval & 0x0400) >> 5;
-#endif
+		if (F::GreenShift == 6)
+			retval |= (retval & 0x0400) >> 5;
 		return retval;
 	}
 
 	static alwaysinline uint16 fn1_2(uint16 C1, uint16 C2)
 	{
-		return ((((C1 & RGB_REMOVE_LOW_BITS_MASK) +
-			(C2 & RGB_REMOVE_LOW_BITS_MASK)) >> 1) +
-			(C1 & C2 & RGB_LOW_BITS_MASK)) | ALPHA_BITS_MASK;
+		return ((((C1 & ~F::LowBitsMask) +
+			(C2 & ~F::LowBitsMask)) >> 1) +
+			(C1 & C2 & F::LowBitsMask)) | F::AlphaMask;
 	}
 };
 
-struct COLOR_ADD_BRIGHTNESS
+template<class F>
+struct COLOR_ADD_BRIGHTNESS_T
 {
 	static alwaysinline uint16 fn(uint16 C1, uint16 C2)
 	{
-		return ((brightness_cap[ (C1 >> RED_SHIFT_BITS)           +  (C2 >> RED_SHIFT_BITS)          ] << RED_SHIFT_BITS)   |
-				(brightness_cap[((C1 >> GREEN_SHIFT_BITS) & 0x1f) + ((C2 >> GREEN_SHIFT_BITS) & 0x1f)] << GREEN_SHIFT_BITS) |
+		return ((brightness_cap[ (C1 >> F::RedShift)           +  (C2 >> F::RedShift)          ] << F::RedShift)   |
+				(brightness_cap[((C1 >> F::GreenShift) & 0x1f) + ((C2 >> F::GreenShift) & 0x1f)] << F::GreenShift) |
 	// Proper 15->16bit color conversion moves the high bit of green into the low bit.
-	#if GREEN_SHIFT_BITS == 6
-			   ((brightness_cap[((C1 >> 6) & 0x1f) + ((C2 >> 6) & 0x1f)] & 0x10) << 1) |
-	#endif
+			   (F::GreenShift == 6 ? ((brightness_cap[((C1 >> 6) & 0x1f) + ((C2 >> 6) & 0x1f)] & 0x10) << 1) : 0) |
 				(brightness_cap[ (C1                      & 0x1f) +  (C2                      & 0x1f)]      ));
 	}
 
 	static alwaysinline uint16 fn1_2(uint16 C1, uint16 C2)
 	{
-		return COLOR_ADD::fn1_2(C1, C2);
+		return COLOR_ADD_T<F>::fn1_2(C1, C2);
 	}
 };
 
 
-struct COLOR_SUB
+template<class F>
+struct COLOR_SUB_T
 {
 	static alwaysinline uint16 fn(uint16 C1, uint16 C2)
 	{
-		int rb1 = (C1 & (THIRD_COLOR_MASK | FIRST_COLOR_MASK)) | ((0x20 << 0) | (0x20 << RED_SHIFT_BITS));
-		int rb2 = C2 & (THIRD_COLOR_MASK | FIRST_COLOR_MASK);
+		int rb1 = (C1 & (F::BlueMask | F::RedMask)) | ((0x20 << 0) | (0x20 << F::RedShift));
+		int rb2 = C2 & (F::BlueMask | F::RedMask);
 		int rb = rb1 - rb2;
-		int rbcarry = rb & ((0x20 << RED_SHIFT_BITS) | (0x20 << 0));
-		int g = ((C1 & (SECOND_COLOR_MASK)) | (0x20 << GREEN_SHIFT_BITS)) - (C2 & (SECOND_COLOR_MASK));
-		int rgbsaturate = (((g & (0x20 << GREEN_SHIFT_BITS)) | rbcarry) >> 5) * 0x1f;
-		uint16 retval = ((rb & (THIRD_COLOR_MASK | FIRST_COLOR_MASK)) | (g & SECOND_COLOR_MASK)) & rgbsaturate;
-#if GREEN_SHIFT_BITS == 6
-		retval |= (retval & 0x0400) >> 5;
-#endif
+		int rbcarry = rb & ((0x20 << F::RedShift) | (0x20 << 0));
+		int g = ((C1 & (F::GreenMask)) | (0x20 << F::GreenShift)) - (C2 & (F::GreenMask));
+		int rgbsaturate = (((g & (0x20 << F::GreenShift)) | rbcarry) >> 5) * 0x1f;
+		uint16 retval = ((rb & (F::BlueMask | F::RedMask)) | (g & F::GreenMask)) & rgbsaturate;
+		if (F::GreenShift == 6)
+			retval |= (retval & 0x0400) >> 5;
 		return retval;
 	}
 
 	static alwaysinline uint16 fn1_2(uint16 C1, uint16 C2)
 	{
-		return GFX.ZERO[((C1 | RGB_HI_BITS_MASKx2) -
-			(C2 & RGB_REMOVE_LOW_BITS_MASK)) >> 1];
+		return GFX.ZERO[((C1 | F::HiBitsMaskx2) -
+			(C2 & ~F::LowBitsMask)) >> 1];
 	}
 };
 
+// For code built for a single format, such as the ports' own
+typedef COLOR_ADD_T<PIXEL_BUILD>			COLOR_ADD;
+typedef COLOR_ADD_BRIGHTNESS_T<PIXEL_BUILD>	COLOR_ADD_BRIGHTNESS;
+typedef COLOR_SUB_T<PIXEL_BUILD>			COLOR_SUB;
+
+// Whether the core renders RGB555 rather than RGB565
+static inline bool8 S9xPixelFormat555 (void)
+{
+	return (GFX.PixelFormat ? GFX.PixelFormat == 555 : PIXEL_BUILD::Format == 555);
+}
+
+static inline uint16 S9xBuildPixel (uint32 R, uint32 G, uint32 B)
+{
+	return (S9xPixelFormat555() ? PIXEL_RGB555::Build(R, G, B) : PIXEL_RGB565::Build(R, G, B));
+}
+
+static inline void S9xDecomposePixel (uint16 Pixel, uint32 &R, uint32 &G, uint32 &B)
+{
+	if (S9xPixelFormat555())
+		PIXEL_RGB555::Decompose(Pixel, R, G, B);
+	else
+		PIXEL_RGB565::Decompose(Pixel, R, G, B);
+}
+
 void S9xStartScreenRefresh (void);
 void S9xEndScreenRefresh (void);
 void S9xBuildDirectColourMaps (void);
 void RenderLine (uint8);
+void S9xUpdateRangeTimeOver (void);
 void S9xComputeClipWindows (void);
 void S9xDisplayChar (uint16 *, uint8);
 void S9xGraphicsScreenResize (void);
@@ -216,6 +315,7 @@ bool8 S9xInitUpdate (void);
 bool8 S9xDeinitUpdate (int, int);
 bool8 S9xContinueUpdate (int, int);
 void S9xReRefresh (void);
+int S9xGetChangedRows (int, int *);
 void S9xSyncSpeed (void);
 
 // called instead of S9xDisplayString if set to non-NULL
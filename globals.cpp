@@ -28,9 +28,9 @@ struct InternalPPU		IPPU;
 struct SDMA				DMA[8];
 struct STimings			Timings;
 struct SGFX				GFX;
-struct SBG				BG;
 struct SLineData		LineData[240];
 struct SLineMatrixData	LineMatrixData[240];
+struct SBGLineCache		BGLineCache[4];
 struct SDSP0			DSP0;
 struct SDSP1			DSP1;
 struct SDSP2			DSP2;
@@ -789,7 +789,7 @@ static int unzFindExtension (unzFile &, const char *, bool restart = TRUE, bool
 
 static void S9xDeinterleaveType1 (int size, uint8 *base)
 {
-	Settings.DisplayColor = BUILD_PIXEL(0, 31, 0);
+	Settings.DisplayColor = S9xBuildPixel(0, 31, 0);
 	SET_UI_COLOR(0, 255, 0);
 
 	uint8	blocks[256];
@@ -828,7 +828,7 @@ static void S9xDeinterleaveType1 (int size, uint8 *base)
 static void S9xDeinterleaveType2 (int size, uint8 *base)
 {
 	// for odd Super FX images
-	Settings.DisplayColor = BUILD_PIXEL(31, 14, 6);
+	Settings.DisplayColor = S9xBuildPixel(31, 14, 6);
 	SET_UI_COLOR(255, 119, 25);
 
 	uint8	blocks[256];
@@ -872,7 +872,7 @@ static void S9xDeinterleaveGD24 (int size, uint8 *base)
 	if (size != 0x300000)
 		return;
 
-	Settings.DisplayColor = BUILD_PIXEL(0, 31, 31);
+	Settings.DisplayColor = S9xBuildPixel(0, 31, 31);
 	SET_UI_COLOR(0, 255, 255);
 
 	uint8	*tmp = (uint8 *) malloc(0x80000);
@@ -1415,7 +1415,7 @@ bool8 CMemory::LoadROM (const char *filename)
 
 bool8 CMemory::LoadROMInt (int32 ROMfillSize)
 {
-	Settings.DisplayColor = BUILD_PIXEL(31, 31, 31);
+	Settings.DisplayColor = S9xBuildPixel(31, 31, 31);
 	SET_UI_COLOR(255, 255, 255);
 
 	CalculatedSize = 0;
@@ -1673,7 +1673,7 @@ bool8 CMemory::LoadMultiCart (const char *cartA, const char *cartB)
     memset(ROM, 0, MAX_ROM_SIZE);
 	memset(&Multi, 0, sizeof(Multi));
 
-	Settings.DisplayColor = BUILD_PIXEL(31, 31, 31);
+	Settings.DisplayColor = S9xBuildPixel(31, 31, 31);
 	SET_UI_COLOR(255, 255, 255);
 
     if (cartB && cartB[0])
@@ -2570,20 +2570,20 @@ void CMemory::InitROM (void)
 	// checksum
 	if (!isChecksumOK || ((uint32) CalculatedSize > (uint32) (((1 << (ROMSize - 7)) * 128) * 1024)))
 	{
-		Settings.DisplayColor = BUILD_PIXEL(31, 31, 0);
+		Settings.DisplayColor = S9xBuildPixel(31, 31, 0);
 		SET_UI_COLOR(255, 255, 0);
 	}
 
 	// Use slight blue tint to indicate ROM was patched.
 	if (Settings.IsPatched)
 	{
-		Settings.DisplayColor = BUILD_PIXEL(26, 26, 31);
+		Settings.DisplayColor = S9xBuildPixel(26, 26, 31);
 		SET_UI_COLOR(216, 216, 255);
 	}
 
 	if (Multi.cartType == 4)
 	{
-		Settings.DisplayColor = BUILD_PIXEL(0, 16, 31);
+		Settings.DisplayColor = S9xBuildPixel(0, 16, 31);
 		SET_UI_COLOR(0, 128, 255);
 	}
 
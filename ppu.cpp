@@ -202,7 +202,7 @@ void S9xFixColourBrightness (void)
 		IPPU.Red[i]   = IPPU.XB[(PPU.CGDATA[i])       & 0x1f];
 		IPPU.Green[i] = IPPU.XB[(PPU.CGDATA[i] >>  5) & 0x1f];
 		IPPU.Blue[i]  = IPPU.XB[(PPU.CGDATA[i] >> 10) & 0x1f];
-		IPPU.ScreenColors[i] = BUILD_PIXEL(IPPU.Red[i], IPPU.Green[i], IPPU.Blue[i]);
+		IPPU.ScreenColors[i] = S9xBuildPixel(IPPU.Red[i], IPPU.Green[i], IPPU.Blue[i]);
 	}
 }
 
@@ -1177,6 +1177,8 @@ uint8 S9xGetPPU (uint16 Address)
 
 			case 0x213e: // STAT77
 				FLUSH_REDRAW();
+				if (!PPU.OBJRangeRead)
+					S9xUpdateRangeTimeOver();
 				byte = (PPU.OpenBus1 & 0x10) | PPU.RangeTimeOver | Model->_5C77;
 				return (PPU.OpenBus1 = byte);
 
@@ -1730,6 +1732,7 @@ void S9xResetPPU (void)
 {
 	S9xSoftResetPPU();
 	S9xControlsReset();
+	PPU.OBJRangeRead = FALSE;
 	PPU.M7HOFS = 0;
 	PPU.M7VOFS = 0;
 	PPU.M7byte = 0;
@@ -1747,6 +1750,9 @@ void S9xResetPPUFast (void)
 	memset(IPPU.TileCached[TILE_2BIT_ODD], 0, MAX_2BIT_TILES);
 	memset(IPPU.TileCached[TILE_4BIT_EVEN], 0, MAX_4BIT_TILES);
 	memset(IPPU.TileCached[TILE_4BIT_ODD], 0, MAX_4BIT_TILES);
+	// VRAM may have been replaced outright, drop what was drawn from it
+	memset(IPPU.VRAMDirtyRows, 0xff, sizeof(IPPU.VRAMDirtyRows));
+	IPPU.VRAMDirty = TRUE;
 }
 
 void S9xSoftResetPPU (void)
@@ -1893,6 +1899,9 @@ void S9xSoftResetPPU (void)
 	memset(IPPU.TileCached[TILE_2BIT_ODD], 0,  MAX_2BIT_TILES);
 	memset(IPPU.TileCached[TILE_4BIT_EVEN], 0, MAX_4BIT_TILES);
 	memset(IPPU.TileCached[TILE_4BIT_ODD], 0,  MAX_4BIT_TILES);
+	// VRAM may have been replaced outright, drop what was drawn from it
+	memset(IPPU.VRAMDirtyRows, 0xff, sizeof(IPPU.VRAMDirtyRows));
+	IPPU.VRAMDirty = TRUE;
 	PPU.VRAMReadBuffer = 0; // XXX: FIXME: anything better?
 	GFX.InterlaceFrame = 0;
 	GFX.DoInterlace = 0;
@@ -104,7 +104,7 @@ bool8 S9xDoScreenshot (int width, int height)
 		{
 			uint32	r, g, b;
 
-			DECOMPOSE_PIXEL(screen[x], r, g, b);
+			S9xDecomposePixel(screen[x], r, g, b);
 
 			*(rowpix++) = r;
 			*(rowpix++) = g;
@@ -346,7 +346,8 @@ static FreezeData	SnapPPU[] =
 	INT_ENTRY(6, HDMAEnded),
 	INT_ENTRY(6, OpenBus1),
 	INT_ENTRY(6, OpenBus2),
-	INT_ENTRY(11, VRAMReadBuffer)
+	INT_ENTRY(11, VRAMReadBuffer),
+	INT_ENTRY(12, OBJRangeRead)
 };
 
 #undef STRUCT
@@ -1284,7 +1285,7 @@ void S9xFreezeToStream (STREAM stream)
 			{
 				uint32	r, g, b;
 
-				DECOMPOSE_PIXEL(screen[x], r, g, b);
+				S9xDecomposePixel(screen[x], r, g, b);
 				*(rowpix++) = r;
 				*(rowpix++) = g;
 				*(rowpix++) = b;
@@ -1565,6 +1566,8 @@ int S9xUnfreezeFromStream (STREAM stream)
 		UnfreezeStructFromCopy(&Registers, SnapRegisters, COUNT(SnapRegisters), local_registers, version);
 
 		UnfreezeStructFromCopy(&PPU, SnapPPU, COUNT(SnapPPU), local_ppu, version);
+		if (version < SNAPSHOT_VERSION_RTO)
+			PPU.OBJRangeRead = TRUE;
 
 		struct SDMASnapshot	dma_snap;
 		UnfreezeStructFromCopy(&dma_snap, SnapDMA, COUNT(SnapDMA), local_dma, version);
@@ -1783,7 +1786,7 @@ int S9xUnfreezeFromStream (STREAM stream)
 							break;
 					}
 
-					screen[x] = BUILD_PIXEL(r, g, b);
+					screen[x] = S9xBuildPixel(r, g, b);
 				}
 
 				if (scaleDownY)
@@ -1911,7 +1914,7 @@ int S9xUnfreezeScreenshotFromStream(STREAM stream, uint16 **image_buffer, int &w
                 g = *(rowpix++);
                 b = *(rowpix++);
 
-                screen[x] = BUILD_PIXEL(r, g, b);
+                screen[x] = S9xBuildPixel(r, g, b);
             }
         }
 
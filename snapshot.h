@@ -13,7 +13,8 @@
 #define SNAPSHOT_VERSION_IRQ		7
 #define SNAPSHOT_VERSION_BAPU		8
 #define SNAPSHOT_VERSION_IRQ_2018	11		// irq changes were introduced earlier, since this we store NextIRQTimer directly
-#define SNAPSHOT_VERSION			11
+#define SNAPSHOT_VERSION_RTO		12		// whether $213E has been read is stored, older ones always kept RangeTimeOver
+#define SNAPSHOT_VERSION			12
 
 #define SUCCESS					1
 #define WRONG_FORMAT			(-1)
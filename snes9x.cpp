@@ -244,12 +244,17 @@ void S9xLoadConfigFiles (char **argv, int argc)
 	Settings.DynamicRateControl         =  conf.GetBool("Sound::DynamicRateControl",           false);
 	Settings.DynamicRateLimit           =  conf.GetInt ("Sound::DynamicRateLimit",             5);
 	Settings.InterpolationMethod        =  conf.GetInt ("Sound::InterpolationMethod",          2);
+	Settings.ThreadedAPU                =  conf.GetBool("Sound::ThreadedAPU",                  false);
+	Settings.ResamplerQuality           =  conf.GetInt ("Sound::ResamplerQuality",             0);
+	Settings.SilentTurbo                =  conf.GetBool("Sound::SilentTurbo",                  false);
 
 	// Display
 
 	Settings.SupportHiRes               =  conf.GetBool("Display::HiRes",                      true);
 	Settings.Transparency               =  conf.GetBool("Display::Transparency",               true);
 	Settings.DisableGraphicWindows      = !conf.GetBool("Display::GraphicWindows",             true);
+	Settings.RenderThreads              =  conf.GetUInt("Display::RenderThreads",              0);
+	Settings.BGLineCache                =  conf.GetBool("Display::BGLineCache",                false);
 	Settings.DisplayTime				=  conf.GetBool("Display::DisplayTime",                false);
 	Settings.DisplayFrameRate           =  conf.GetBool("Display::DisplayFrameRate",           false);
 	Settings.DisplayWatchedAddresses    =  conf.GetBool("Display::DisplayWatchedAddresses",    false);
@@ -366,6 +371,9 @@ void S9xUsage (void)
 	S9xMessage(S9X_INFO, S9X_USAGE, "-nostereo                       Disable stereo sound output");
 	S9xMessage(S9X_INFO, S9X_USAGE, "-eightbit                       Use 8bit sound instead of 16bit");
 	S9xMessage(S9X_INFO, S9X_USAGE, "-mute                           Mute sound");
+	S9xMessage(S9X_INFO, S9X_USAGE, "-threadedapu                    Run the sound CPU and DSP on a separate thread");
+	S9xMessage(S9X_INFO, S9X_USAGE, "-resamplerquality <num>         Output resampler: 0 cubic, 1-3 windowed sinc (8/16/32 taps)");
+	S9xMessage(S9X_INFO, S9X_USAGE, "-silentturbo                    Don't generate sound while in turbo mode");
 	S9xMessage(S9X_INFO, S9X_USAGE, "");
 
 	// DISPLAY OPTIONS
@@ -376,6 +384,8 @@ void S9xUsage (void)
 	S9xMessage(S9X_INFO, S9X_USAGE, "                                interlace modes");
 	S9xMessage(S9X_INFO, S9X_USAGE, "-notransparency                 (Not recommended) Disable transparency effects");
 	S9xMessage(S9X_INFO, S9X_USAGE, "-nowindows                      (Not recommended) Disable graphic window effects");
+	S9xMessage(S9X_INFO, S9X_USAGE, "-renderthreads <num>            Draw the screen with <num> threads (0 = off)");
+	S9xMessage(S9X_INFO, S9X_USAGE, "-bglinecache                    Keep background layers drawn across frames");
 	S9xMessage(S9X_INFO, S9X_USAGE, "");
 
 	// CONTROLLER OPTIONS
@@ -538,6 +548,24 @@ char * S9xParseArgs (char **argv, int argc)
 			if (!strcasecmp(argv[i], "-mute"))
 				Settings.Mute = TRUE;
 			else
+			if (!strcasecmp(argv[i], "-threadedapu"))
+				Settings.ThreadedAPU = TRUE;
+			else
+			if (!strcasecmp(argv[i], "-resamplerquality"))
+			{
+				if (i + 1 < argc)
+				{
+					Settings.ResamplerQuality = atoi(argv[++i]);
+					if (Settings.ResamplerQuality < 0 || Settings.ResamplerQuality > 3)
+						Settings.ResamplerQuality = 0;
+				}
+				else
+					S9xUsage();
+			}
+			else
+			if (!strcasecmp(argv[i], "-silentturbo"))
+				Settings.SilentTurbo = TRUE;
+			else
 
 			// DISPLAY OPTIONS
 
@@ -559,6 +587,17 @@ char * S9xParseArgs (char **argv, int argc)
 			if (!strcasecmp(argv[i], "-nowindows"))
 				Settings.DisableGraphicWindows = TRUE;
 			else
+			if (!strcasecmp(argv[i], "-renderthreads"))
+			{
+				if (i + 1 < argc)
+					Settings.RenderThreads = atoi(argv[++i]);
+				else
+					S9xUsage();
+			}
+			else
+			if (!strcasecmp(argv[i], "-bglinecache"))
+				Settings.BGLineCache = TRUE;
+			else
 
 			// CONTROLLER OPTIONS
 
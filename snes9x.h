@@ -241,11 +241,16 @@ struct SSettings
 	bool8	DynamicRateControl;
 	int32	DynamicRateLimit; /* Multiplied by 1000 */
 	int32	InterpolationMethod;
+	bool8	ThreadedAPU;
+	int32	ResamplerQuality;
+	bool8	SilentTurbo;
 
 	bool8	SupportHiRes;
 	bool8	Transparency;
 	uint8	BG_Forced;
 	bool8	DisableGraphicWindows;
+	uint32	RenderThreads;
+	bool8	BGLineCache;
 
 	bool8	DisplayTime;
 	bool8	DisplayFrameRate;
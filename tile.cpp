@@ -4,6 +4,9 @@
    For further information, consult the LICENSE file in the root directory.
 \*****************************************************************************/
 
+#ifdef USE_THREADS
+#include <thread>
+#endif
 #include "tileimpl.h"
 
 using namespace TileImpl;
@@ -14,6 +17,113 @@ namespace {
 	uint8	hrbit_odd[256];
 	uint8	hrbit_even[256];
 
+#ifdef TILE_SSE2
+	// SSE2 planar to chunky conversion of a whole tile. The bytes of two
+	// bitplanes are spread out so that each row becomes one register holding
+	// [plane a x 8 | plane b x 8], every lane is tested against the bit of its
+	// pixel, and the matches are turned into the plane's weight.
+
+	// 16 bytes of interleaved plane pairs for rows 0-7
+	alwaysinline void SpreadPlanes (__m128i v, __m128i *rows)
+	{
+		__m128i	a0 = _mm_unpacklo_epi8(v, v);
+		__m128i	a1 = _mm_unpackhi_epi8(v, v);
+		__m128i	b0 = _mm_unpacklo_epi16(a0, a0);
+		__m128i	b1 = _mm_unpackhi_epi16(a0, a0);
+		__m128i	b2 = _mm_unpacklo_epi16(a1, a1);
+		__m128i	b3 = _mm_unpackhi_epi16(a1, a1);
+
+		rows[0] = _mm_unpacklo_epi32(b0, b0);
+		rows[1] = _mm_unpackhi_epi32(b0, b0);
+		rows[2] = _mm_unpacklo_epi32(b1, b1);
+		rows[3] = _mm_unpackhi_epi32(b1, b1);
+		rows[4] = _mm_unpacklo_epi32(b2, b2);
+		rows[5] = _mm_unpackhi_epi32(b2, b2);
+		rows[6] = _mm_unpacklo_epi32(b3, b3);
+		rows[7] = _mm_unpackhi_epi32(b3, b3);
+	}
+
+	// Hires: the left four pixels come from v1 and the right four from v2
+	alwaysinline void SpreadPlanesHires (__m128i v1, __m128i v2, __m128i *rows)
+	{
+		__m128i	u0 = _mm_unpacklo_epi8(v1, v2);
+		__m128i	u1 = _mm_unpackhi_epi8(v1, v2);
+		__m128i	a0 = _mm_unpacklo_epi8(u0, u0);
+		__m128i	a1 = _mm_unpackhi_epi8(u0, u0);
+		__m128i	a2 = _mm_unpacklo_epi8(u1, u1);
+		__m128i	a3 = _mm_unpackhi_epi8(u1, u1);
+
+		rows[0] = _mm_unpacklo_epi16(a0, a0);
+		rows[1] = _mm_unpackhi_epi16(a0, a0);
+		rows[2] = _mm_unpacklo_epi16(a1, a1);
+		rows[3] = _mm_unpackhi_epi16(a1, a1);
+		rows[4] = _mm_unpacklo_epi16(a2, a2);
+		rows[5] = _mm_unpackhi_epi16(a2, a2);
+		rows[6] = _mm_unpacklo_epi16(a3, a3);
+		rows[7] = _mm_unpackhi_epi16(a3, a3);
+	}
+
+	alwaysinline void AddPlanes (const __m128i *rows, __m128i mask, int plane, __m128i *acc)
+	{
+		__m128i	weight = _mm_set_epi64x((int64) (0x0101010101010101ULL << (plane + 1)), (int64) (0x0101010101010101ULL << plane));
+
+		for (int r = 0; r < 8; r++)
+			acc[r] = _mm_or_si128(acc[r], _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(rows[r], mask), mask), weight));
+	}
+
+	// Folds each row's two planes together and writes two rows per store
+	alwaysinline uint8 StoreTile (const __m128i *acc, uint8 *pCache)
+	{
+		__m128i	non_zero = _mm_setzero_si128();
+
+		for (int r = 0; r < 8; r += 2)
+		{
+			__m128i	pix = _mm_or_si128(_mm_unpacklo_epi64(acc[r], acc[r + 1]), _mm_unpackhi_epi64(acc[r], acc[r + 1]));
+			_mm_storeu_si128((__m128i *) (pCache + r * 8), pix);
+			non_zero = _mm_or_si128(non_zero, pix);
+		}
+
+		return (_mm_movemask_epi8(_mm_cmpeq_epi8(non_zero, _mm_setzero_si128())) != 0xffff ? TRUE : BLANK_TILE);
+	}
+
+	template<int Planes>
+	alwaysinline uint8 ConvertPlanesSSE2 (uint8 *pCache, const uint8 *tp)
+	{
+		const __m128i	mask = _mm_set1_epi64x(0x0102040810204080LL);
+		__m128i			rows[8], acc[8];
+
+		for (int r = 0; r < 8; r++)
+			acc[r] = _mm_setzero_si128();
+
+		for (int plane = 0; plane < Planes; plane += 2)
+		{
+			SpreadPlanes(_mm_loadu_si128((const __m128i *) (tp + plane * 8)), rows);
+			AddPlanes(rows, mask, plane, acc);
+		}
+
+		return (StoreTile(acc, pCache));
+	}
+
+	// Even columns are bits 7, 5, 3, 1 of each plane byte, odd ones 6, 4, 2, 0
+	template<int Planes, bool Odd>
+	alwaysinline uint8 ConvertPlanesHiresSSE2 (uint8 *pCache, const uint8 *tp1, const uint8 *tp2)
+	{
+		const __m128i	mask = _mm_set1_epi64x(Odd ? 0x0104104001041040LL : 0x0208208002082080LL);
+		__m128i			rows[8], acc[8];
+
+		for (int r = 0; r < 8; r++)
+			acc[r] = _mm_setzero_si128();
+
+		for (int plane = 0; plane < Planes; plane += 2)
+		{
+			SpreadPlanesHires(_mm_loadu_si128((const __m128i *) (tp1 + plane * 8)), _mm_loadu_si128((const __m128i *) (tp2 + plane * 8)), rows);
+			AddPlanes(rows, mask, plane, acc);
+		}
+
+		return (StoreTile(acc, pCache));
+	}
+#endif
+
 	// Here are the tile converters, selected by S9xSelectTileConverter().
 	// Really, except for the definition of DOBIT and the number of times it is called, they're all the same.
 
@@ -26,6 +136,9 @@ namespace {
 
 	uint8 ConvertTile2 (uint8 *pCache, uint32 TileAddr, uint32)
 	{
+	#ifdef TILE_SSE2
+		return (ConvertPlanesSSE2<2>(pCache, &Memory.VRAM[TileAddr]));
+	#else
 		uint8	*tp      = &Memory.VRAM[TileAddr];
 		uint32			*p       = (uint32 *) pCache;
 		uint32			non_zero = 0;
@@ -45,10 +158,14 @@ namespace {
 		}
 
 		return (non_zero ? TRUE : BLANK_TILE);
+	#endif
 	}
 
 	uint8 ConvertTile4 (uint8 *pCache, uint32 TileAddr, uint32)
 	{
+	#ifdef TILE_SSE2
+		return (ConvertPlanesSSE2<4>(pCache, &Memory.VRAM[TileAddr]));
+	#else
 		uint8	*tp      = &Memory.VRAM[TileAddr];
 		uint32			*p       = (uint32 *) pCache;
 		uint32			non_zero = 0;
@@ -70,10 +187,14 @@ namespace {
 		}
 
 		return (non_zero ? TRUE : BLANK_TILE);
+	#endif
 	}
 
 	uint8 ConvertTile8 (uint8 *pCache, uint32 TileAddr, uint32)
 	{
+	#ifdef TILE_SSE2
+		return (ConvertPlanesSSE2<8>(pCache, &Memory.VRAM[TileAddr]));
+	#else
 		uint8	*tp      = &Memory.VRAM[TileAddr];
 		uint32			*p       = (uint32 *) pCache;
 		uint32			non_zero = 0;
@@ -99,6 +220,7 @@ namespace {
 		}
 
 		return (non_zero ? TRUE : BLANK_TILE);
+	#endif
 	}
 
 	#undef DOBIT
@@ -112,15 +234,19 @@ namespace {
 	uint8 ConvertTile2h_odd (uint8 *pCache, uint32 TileAddr, uint32 Tile)
 	{
 		uint8	*tp1     = &Memory.VRAM[TileAddr], *tp2;
-		uint32			*p       = (uint32 *) pCache;
-		uint32			non_zero = 0;
-		uint8			line;
 
 		if (Tile == 0x3ff)
 			tp2 = tp1 - (0x3ff << 4);
 		else
 			tp2 = tp1 + (1 << 4);
 
+	#ifdef TILE_SSE2
+		return (ConvertPlanesHiresSSE2<2, true>(pCache, tp1, tp2));
+	#else
+		uint32			*p       = (uint32 *) pCache;
+		uint32			non_zero = 0;
+		uint8			line;
+
 		for (line = 8; line != 0; line--, tp1 += 2, tp2 += 2)
 		{
 			uint32			p1 = 0;
@@ -135,20 +261,25 @@ namespace {
 		}
 
 		return (non_zero ? TRUE : BLANK_TILE);
+	#endif
 	}
 
 	uint8 ConvertTile4h_odd (uint8 *pCache, uint32 TileAddr, uint32 Tile)
 	{
 		uint8	*tp1     = &Memory.VRAM[TileAddr], *tp2;
-		uint32			*p       = (uint32 *) pCache;
-		uint32			non_zero = 0;
-		uint8			line;
 
 		if (Tile == 0x3ff)
 			tp2 = tp1 - (0x3ff << 5);
 		else
 			tp2 = tp1 + (1 << 5);
 
+	#ifdef TILE_SSE2
+		return (ConvertPlanesHiresSSE2<4, true>(pCache, tp1, tp2));
+	#else
+		uint32			*p       = (uint32 *) pCache;
+		uint32			non_zero = 0;
+		uint8			line;
+
 		for (line = 8; line != 0; line--, tp1 += 2, tp2 += 2)
 		{
 			uint32			p1 = 0;
@@ -165,6 +296,7 @@ namespace {
 		}
 
 		return (non_zero ? TRUE : BLANK_TILE);
+	#endif
 	}
 
 	#undef DOBIT
@@ -178,15 +310,19 @@ namespace {
 	uint8 ConvertTile2h_even (uint8 *pCache, uint32 TileAddr, uint32 Tile)
 	{
 		uint8	*tp1     = &Memory.VRAM[TileAddr], *tp2;
-		uint32			*p       = (uint32 *) pCache;
-		uint32			non_zero = 0;
-		uint8			line;
 
 		if (Tile == 0x3ff)
 			tp2 = tp1 - (0x3ff << 4);
 		else
 			tp2 = tp1 + (1 << 4);
 
+	#ifdef TILE_SSE2
+		return (ConvertPlanesHiresSSE2<2, false>(pCache, tp1, tp2));
+	#else
+		uint32			*p       = (uint32 *) pCache;
+		uint32			non_zero = 0;
+		uint8			line;
+
 		for (line = 8; line != 0; line--, tp1 += 2, tp2 += 2)
 		{
 			uint32			p1 = 0;
@@ -201,20 +337,25 @@ namespace {
 		}
 
 		return (non_zero ? TRUE : BLANK_TILE);
+	#endif
 	}
 
 	uint8 ConvertTile4h_even (uint8 *pCache, uint32 TileAddr, uint32 Tile)
 	{
 		uint8	*tp1     = &Memory.VRAM[TileAddr], *tp2;
-		uint32			*p       = (uint32 *) pCache;
-		uint32			non_zero = 0;
-		uint8			line;
 
 		if (Tile == 0x3ff)
 			tp2 = tp1 - (0x3ff << 5);
 		else
 			tp2 = tp1 + (1 << 5);
 
+	#ifdef TILE_SSE2
+		return (ConvertPlanesHiresSSE2<4, false>(pCache, tp1, tp2));
+	#else
+		uint32			*p       = (uint32 *) pCache;
+		uint32			non_zero = 0;
+		uint8			line;
+
 		for (line = 8; line != 0; line--, tp1 += 2, tp2 += 2)
 		{
 			uint32			p1 = 0;
@@ -231,10 +372,184 @@ namespace {
 		}
 
 		return (non_zero ? TRUE : BLANK_TILE);
+	#endif
 	}
 
 	#undef DOBIT
 
+#ifdef TILE_SSE2
+	// SSE2 versions of COLOR_ADD, COLOR_SUB and COLOR_ADD_BRIGHTNESS for
+	// S9xComposeMath, 8 pixels at a time. Each component is moved to the top of
+	// a 16-bit lane, so the saturating adds and subtracts clamp it just like the
+	// carry tricks of the scalar versions do.
+
+	alwaysinline __m128i Top (__m128i c, int shift, uint16 mask)
+	{
+		return (_mm_and_si128(_mm_slli_epi16(c, shift), _mm_set1_epi16((int16) mask)));
+	}
+
+	template<class F>
+	alwaysinline __m128i Compose (__m128i r, __m128i g, __m128i b)
+	{
+		__m128i	c = _mm_or_si128(_mm_or_si128(_mm_srli_epi16(r, 11 - F::RedShift), _mm_srli_epi16(g, 11 - F::GreenShift)), _mm_srli_epi16(b, 11));
+		if (F::GreenShift == 6)
+			c = _mm_or_si128(c, _mm_srli_epi16(_mm_and_si128(c, _mm_set1_epi16(0x0400)), 5));
+		return (c);
+	}
+
+	alwaysinline __m128i Select (__m128i mask, __m128i a, __m128i b)
+	{
+		return (_mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b)));
+	}
+
+	template<class F>
+	struct SIMD_COLOR_ADD
+	{
+		enum { RED_TOP = 11 - F::RedShift, GREEN_TOP = 11 - F::GreenShift };
+
+		static alwaysinline __m128i fn (__m128i c1, __m128i c2)
+		{
+			const __m128i	top = _mm_set1_epi16((int16) 0xf800);
+
+			__m128i	r = _mm_adds_epu16(Top(c1, RED_TOP, 0xf800), Top(c2, RED_TOP, 0xf800));
+			__m128i	g = _mm_adds_epu16(Top(c1, GREEN_TOP, 0xf800), Top(c2, GREEN_TOP, 0xf800));
+			__m128i	b = _mm_adds_epu16(_mm_slli_epi16(c1, 11), _mm_slli_epi16(c2, 11));
+
+			return (Compose<F>(_mm_and_si128(r, top), _mm_and_si128(g, top), _mm_and_si128(b, top)));
+		}
+
+		static alwaysinline __m128i fn1_2 (__m128i c1, __m128i c2)
+		{
+			const __m128i	low = _mm_set1_epi16((int16) F::LowBitsMask);
+
+			__m128i	c = _mm_add_epi16(_mm_srli_epi16(_mm_andnot_si128(low, c1), 1), _mm_srli_epi16(_mm_andnot_si128(low, c2), 1));
+			c = _mm_add_epi16(c, _mm_and_si128(_mm_and_si128(c1, c2), low));
+
+			return (_mm_or_si128(c, _mm_set1_epi16((int16) F::AlphaMask)));
+		}
+	};
+
+	template<class F>
+	struct SIMD_COLOR_ADD_BRIGHTNESS
+	{
+		enum { RED_TOP = 11 - F::RedShift, GREEN_TOP = 11 - F::GreenShift };
+
+		static alwaysinline __m128i fn (__m128i c1, __m128i c2)
+		{
+			// brightness_cap[] is the sum capped at the brightest level
+			const __m128i	cap = _mm_set1_epi16((int16) (brightness_cap[63] << 11));
+
+			__m128i	r = _mm_adds_epu16(Top(c1, RED_TOP, 0xf800), Top(c2, RED_TOP, 0xf800));
+			__m128i	g = _mm_adds_epu16(Top(c1, GREEN_TOP, 0xf800), Top(c2, GREEN_TOP, 0xf800));
+			__m128i	b = _mm_adds_epu16(_mm_slli_epi16(c1, 11), _mm_slli_epi16(c2, 11));
+
+			r = _mm_sub_epi16(r, _mm_subs_epu16(r, cap));
+			g = _mm_sub_epi16(g, _mm_subs_epu16(g, cap));
+			b = _mm_sub_epi16(b, _mm_subs_epu16(b, cap));
+
+			return (Compose<F>(r, g, b));
+		}
+
+		static alwaysinline __m128i fn1_2 (__m128i c1, __m128i c2)
+		{
+			return (SIMD_COLOR_ADD<F>::fn1_2(c1, c2));
+		}
+	};
+
+	template<class F>
+	struct SIMD_COLOR_SUB
+	{
+		enum { RED_TOP = 11 - F::RedShift, GREEN_TOP = 11 - F::GreenShift };
+
+		static alwaysinline __m128i fn (__m128i c1, __m128i c2)
+		{
+			const uint16	green = (F::GreenMask << GREEN_TOP) & 0xffff;
+
+			__m128i	r = _mm_subs_epu16(Top(c1, RED_TOP, 0xf800), Top(c2, RED_TOP, 0xf800));
+			__m128i	g = _mm_subs_epu16(Top(c1, GREEN_TOP, green), Top(c2, GREEN_TOP, green));
+			__m128i	b = _mm_subs_epu16(_mm_slli_epi16(c1, 11), _mm_slli_epi16(c2, 11));
+
+			return (Compose<F>(r, _mm_and_si128(g, _mm_set1_epi16((int16) 0xf800)), b));
+		}
+
+		// GFX.ZERO[((C1 | RGB_HI_BITS_MASKx2) - (C2 & RGB_REMOVE_LOW_BITS_MASK)) >> 1]
+		static alwaysinline __m128i fn1_2 (__m128i c1, __m128i c2)
+		{
+			const __m128i	red   = _mm_set1_epi16((int16) F::RedHiBit);
+			const __m128i	green = _mm_set1_epi16((int16) F::GreenHiBit);
+			const __m128i	blue  = _mm_set1_epi16((int16) F::BlueHiBit);
+
+			__m128i	a = _mm_or_si128(c1, _mm_set1_epi16((int16) (F::HiBitsMaskx2 & 0xffff)));
+			__m128i	b = _mm_andnot_si128(_mm_set1_epi16((int16) F::LowBitsMask), c2);
+			__m128i	d = _mm_srli_epi16(_mm_sub_epi16(a, b), 1);
+			if (F::HiBitsMaskx2 > 0xffff)
+			{
+				// The guard bit above red is bit 16, which survives unless b > a
+				__m128i	ge = _mm_cmpeq_epi16(_mm_subs_epu16(b, a), _mm_setzero_si128());
+				d = _mm_or_si128(d, _mm_and_si128(ge, _mm_set1_epi16((int16) 0x8000)));
+			}
+
+			// GFX.ZERO keeps a component, minus its top bit, only if that bit is set
+			__m128i	m = _mm_and_si128(_mm_cmpeq_epi16(_mm_and_si128(d, red), red), _mm_set1_epi16((int16) (F::RedMask & ~F::RedHiBit)));
+			m = _mm_or_si128(m, _mm_and_si128(_mm_cmpeq_epi16(_mm_and_si128(d, green), green), _mm_set1_epi16((int16) (F::GreenMask & ~F::GreenHiBit))));
+			m = _mm_or_si128(m, _mm_and_si128(_mm_cmpeq_epi16(_mm_and_si128(d, blue), blue), _mm_set1_epi16((int16) (F::BlueMask & ~F::BlueHiBit))));
+
+			return (_mm_and_si128(d, m));
+		}
+	};
+
+	// How REGMATH, MATHF1_2 and MATHS1_2 pick between fn and fn1_2
+	enum
+	{
+		MATH_FULL,
+		MATH_FIXED_HALF,
+		MATH_SUB_HALF
+	};
+
+	template<class Op, int Half>
+	void ComposeLines (struct SBG &BG)
+	{
+		const __m128i	zero  = _mm_setzero_si128();
+		const __m128i	fixed = _mm_set1_epi16((int16) GFX.FixedColour);
+		const __m128i	bit5  = _mm_set1_epi16(0x20);
+		const __m128i	two   = _mm_set1_epi16(2);
+
+		uint32	Offset = BG.StartY * GFX.PPL;
+		uint32	Width  = IPPU.DoubleWidthPixels ? SNES_WIDTH << 1 : SNES_WIDTH;
+
+		for (uint32 l = BG.StartY; l <= BG.EndY; l++, Offset += GFX.PPL)
+		{
+			for (uint32 x = Offset; x < Offset + Width; x += 8)
+			{
+				__m128i	flags = _mm_loadl_epi64((__m128i *) (GFX.MathBuffer + x));
+				if ((_mm_movemask_epi8(_mm_cmpeq_epi8(flags, zero)) & 0xff) == 0xff)
+					continue;
+
+				flags = _mm_unpacklo_epi8(flags, zero);
+
+				__m128i	main = _mm_loadu_si128((__m128i *) (BG.S + x));
+				__m128i	sub  = _mm_loadu_si128((__m128i *) (GFX.SubScreen + x));
+				__m128i	sd   = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i *) (GFX.SubZBuffer + x)), zero);
+
+				__m128i	use_sub = _mm_cmpeq_epi16(_mm_and_si128(sd, bit5), bit5);
+				__m128i	src = (Half == MATH_FIXED_HALF) ? fixed : Select(use_sub, sub, fixed);
+				__m128i	c = Op::fn(main, src);
+
+				if (Half != MATH_FULL)
+				{
+					__m128i	half = _mm_cmpeq_epi16(_mm_and_si128(flags, two), zero);
+					if (Half == MATH_SUB_HALF)
+						half = _mm_and_si128(half, use_sub);
+					c = Select(half, Op::fn1_2(main, src), c);
+				}
+
+				c = Select(_mm_cmpeq_epi16(flags, zero), main, c);
+				_mm_storeu_si128((__m128i *) (BG.S + x), c);
+			}
+		}
+	}
+#endif
+
 } // anonymous namespace
 
 void S9xInitTileRenderer (void)
@@ -296,10 +611,519 @@ void S9xInitTileRenderer (void)
 	}
 }
 
+// Fetches Count Mode 7 pixels, starting at the 16.8 fixed point playfield
+// coordinates (X, Y) and stepping by (dX, dY). Pixels outside of the playfield
+// are 0 unless PPU.Mode7Repeat fills it with tile 0.
+void S9xFetchMode7Pixels (uint8 *Pixels, int Count, int32 X, int32 Y, int32 dX, int32 dY)
+{
+	uint8	*VRAM1 = Memory.VRAM + 1;
+	int		i = 0;
+
+#ifdef TILE_SSE2
+	// The coordinates and both VRAM addresses are worked out 8 pixels at a
+	// time; only the two byte fetches per pixel are left to do one by one.
+	const __m128i	wrap = _mm_set1_epi32(0x3ff);
+	const __m128i	zero = _mm_setzero_si128();
+
+	__m128i	xa = _mm_set_epi32(X + 3 * dX, X + 2 * dX, X + dX, X);
+	__m128i	ya = _mm_set_epi32(Y + 3 * dY, Y + 2 * dY, Y + dY, Y);
+	__m128i	xb = _mm_add_epi32(xa, _mm_set1_epi32(4 * dX));
+	__m128i	yb = _mm_add_epi32(ya, _mm_set1_epi32(4 * dY));
+	__m128i	dx = _mm_set1_epi32(8 * dX);
+	__m128i	dy = _mm_set1_epi32(8 * dY);
+
+	for (; i + 8 <= Count; i += 8)
+	{
+		__m128i	x1 = _mm_srai_epi32(xa, 8), y1 = _mm_srai_epi32(ya, 8);
+		__m128i	x2 = _mm_srai_epi32(xb, 8), y2 = _mm_srai_epi32(yb, 8);
+
+		uint16	inside[8];
+		if (PPU.Mode7Repeat)
+		{
+			__m128i	in1 = _mm_cmpeq_epi32(_mm_andnot_si128(wrap, _mm_or_si128(x1, y1)), zero);
+			__m128i	in2 = _mm_cmpeq_epi32(_mm_andnot_si128(wrap, _mm_or_si128(x2, y2)), zero);
+			_mm_storeu_si128((__m128i *) inside, _mm_packs_epi32(in1, in2));
+		}
+
+		x1 = _mm_and_si128(x1, wrap); y1 = _mm_and_si128(y1, wrap);
+		x2 = _mm_and_si128(x2, wrap); y2 = _mm_and_si128(y2, wrap);
+
+		// ((Y & ~7) << 5) + ((X >> 2) & ~1) and ((Y & 7) << 4) + ((X & 7) << 1)
+		__m128i	t1 = _mm_or_si128(_mm_slli_epi32(_mm_and_si128(y1, _mm_set1_epi32(0x3f8)), 5), _mm_and_si128(_mm_srli_epi32(x1, 2), _mm_set1_epi32(0xfe)));
+		__m128i	t2 = _mm_or_si128(_mm_slli_epi32(_mm_and_si128(y2, _mm_set1_epi32(0x3f8)), 5), _mm_and_si128(_mm_srli_epi32(x2, 2), _mm_set1_epi32(0xfe)));
+		__m128i	p1 = _mm_or_si128(_mm_slli_epi32(_mm_and_si128(y1, _mm_set1_epi32(7)), 4), _mm_slli_epi32(_mm_and_si128(x1, _mm_set1_epi32(7)), 1));
+		__m128i	p2 = _mm_or_si128(_mm_slli_epi32(_mm_and_si128(y2, _mm_set1_epi32(7)), 4), _mm_slli_epi32(_mm_and_si128(x2, _mm_set1_epi32(7)), 1));
+
+		uint16	tile[8], pixel[8];
+		_mm_storeu_si128((__m128i *) tile, _mm_packs_epi32(t1, t2));
+		_mm_storeu_si128((__m128i *) pixel, _mm_packs_epi32(p1, p2));
+
+		if (!PPU.Mode7Repeat)
+		{
+			for (int k = 0; k < 8; k++)
+				Pixels[i + k] = VRAM1[(Memory.VRAM[tile[k]] << 7) + pixel[k]];
+		}
+		else
+		{
+			for (int k = 0; k < 8; k++)
+			{
+				if (inside[k])
+					Pixels[i + k] = VRAM1[(Memory.VRAM[tile[k]] << 7) + pixel[k]];
+				else
+					Pixels[i + k] = (PPU.Mode7Repeat == 3) ? VRAM1[pixel[k]] : 0;
+			}
+		}
+
+		xa = _mm_add_epi32(xa, dx); ya = _mm_add_epi32(ya, dy);
+		xb = _mm_add_epi32(xb, dx); yb = _mm_add_epi32(yb, dy);
+	}
+
+	X += i * dX;
+	Y += i * dY;
+#endif
+
+	for (; i < Count; i++, X += dX, Y += dY)
+	{
+		int	x = X >> 8;
+		int	y = Y >> 8;
+
+		if (!PPU.Mode7Repeat)
+		{
+			x &= 0x3ff;
+			y &= 0x3ff;
+		}
+		else
+		if ((x | y) & ~0x3ff)
+		{
+			Pixels[i] = (PPU.Mode7Repeat == 3) ? VRAM1[((y & 7) << 4) + ((x & 7) << 1)] : 0;
+			continue;
+		}
+
+		uint8	*TileData = VRAM1 + (Memory.VRAM[((y & ~7) << 5) + ((x >> 2) & ~1)] << 7);
+		Pixels[i] = *(TileData + ((y & 7) << 4) + ((x & 7) << 1));
+	}
+}
+
+namespace {
+
+	// Converts Count pixels of format F to XRGB8888, widening each 5 bit
+	// channel to 8 bits by repeating its top bits.
+	template<class F>
+	void ConvertPixels32 (uint32 *Dst, const uint16 *Src, int Count)
+	{
+		int	i = 0;
+
+	#ifdef TILE_SSE2
+		const __m128i	five = _mm_set1_epi16(0x1f);
+
+		for (; i + 8 <= Count; i += 8)
+		{
+			__m128i	p = _mm_loadu_si128((const __m128i *) (Src + i));
+			__m128i	r = _mm_and_si128(_mm_srli_epi16(p, F::RedShift), five);
+			__m128i	g = _mm_and_si128(_mm_srli_epi16(p, F::GreenShift), five);
+			__m128i	b = _mm_and_si128(p, five);
+
+			r = _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2));
+			g = _mm_or_si128(_mm_slli_epi16(g, 3), _mm_srli_epi16(g, 2));
+			b = _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2));
+
+			__m128i	gb = _mm_or_si128(_mm_slli_epi16(g, 8), b);
+			_mm_storeu_si128((__m128i *) (Dst + i),     _mm_unpacklo_epi16(gb, r));
+			_mm_storeu_si128((__m128i *) (Dst + i + 4), _mm_unpackhi_epi16(gb, r));
+		}
+	#endif
+
+		for (; i < Count; i++)
+		{
+			uint32	p = Src[i];
+			uint32	r = (p >> F::RedShift) & 0x1f, g = (p >> F::GreenShift) & 0x1f, b = p & 0x1f;
+
+			Dst[i] = ((r << 3 | r >> 2) << 16) | ((g << 3 | g >> 2) << 8) | (b << 3 | b >> 2);
+		}
+	}
+
+#ifdef TILE_SSE2
+	template<class F>
+	void ComposeMath (struct SBG &BG)
+	{
+		switch (BG.DeferredMath)
+		{
+			case 1: ComposeLines<SIMD_COLOR_ADD<F>, MATH_FULL>(BG); break;
+			case 2: ComposeLines<SIMD_COLOR_ADD<F>, MATH_FIXED_HALF>(BG); break;
+			case 3: ComposeLines<SIMD_COLOR_ADD<F>, MATH_SUB_HALF>(BG); break;
+			case 4: ComposeLines<SIMD_COLOR_SUB<F>, MATH_FULL>(BG); break;
+			case 5: ComposeLines<SIMD_COLOR_SUB<F>, MATH_FIXED_HALF>(BG); break;
+			case 6: ComposeLines<SIMD_COLOR_SUB<F>, MATH_SUB_HALF>(BG); break;
+			case 7: ComposeLines<SIMD_COLOR_ADD_BRIGHTNESS<F>, MATH_FULL>(BG); break;
+			case 8: ComposeLines<SIMD_COLOR_ADD_BRIGHTNESS<F>, MATH_SUB_HALF>(BG); break;
+		}
+	}
+#endif
+
+} // anonymous namespace
+
+// Converts Count pixels of the rendered format to XRGB8888.
+void S9xConvertPixels32 (uint32 *Dst, const uint16 *Src, int Count)
+{
+	if (S9xPixelFormat555())
+		ConvertPixels32<PIXEL_RGB555>(Dst, Src, Count);
+	else
+		ConvertPixels32<PIXEL_RGB565>(Dst, Src, Count);
+}
+
+// Applies the color math that the main screen renderers left in
+// GFX.MathBuffer to lines BG.StartY to BG.EndY.
+void S9xComposeMath (struct SBG &BG)
+{
+#ifdef TILE_SSE2
+	if (S9xPixelFormat555())
+		ComposeMath<PIXEL_RGB555>(BG);
+	else
+		ComposeMath<PIXEL_RGB565>(BG);
+#endif
+}
+
+#ifdef USE_THREADS
+#define TILE_CONVERTING	0xff
+
+// With Settings.RenderThreads, several threads can reach an unconverted tile at
+// once. The first one claims it and converts it, the others wait for the result.
+uint8 S9xConvertTileShared (uint8 *Buffered, uint8 (*Convert) (uint8 *, uint32, uint32), uint8 *pCache, uint32 TileAddr, uint32 Tile)
+{
+	uint8	state = 0;
+
+	if (__atomic_compare_exchange_n(Buffered, &state, TILE_CONVERTING, false, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+	{
+		state = Convert(pCache, TileAddr, Tile);
+		__atomic_store_n(Buffered, state, __ATOMIC_RELEASE);
+		return (state);
+	}
+
+	while (state == TILE_CONVERTING)
+	{
+		std::this_thread::yield();
+		state = __atomic_load_n(Buffered, __ATOMIC_ACQUIRE);
+	}
+
+	return (state);
+}
+#endif
+
+static void InvalidateBGLines (struct SBGLineCache *);
+
+static void InvalidateTiles (uint32 address, uint32 size)
+{
+	uint32	last = address + size - 1;
+	uint32	t2 = address >> 4, t4 = address >> 5, t8 = address >> 6;
+
+	memset(IPPU.TileCached[TILE_2BIT] + t2, FALSE, (last >> 4) - t2 + 1);
+	memset(IPPU.TileCached[TILE_4BIT] + t4, FALSE, (last >> 5) - t4 + 1);
+	memset(IPPU.TileCached[TILE_8BIT] + t8, FALSE, (last >> 6) - t8 + 1);
+
+	// Even and odd tiles are made of two, so the one before is also touched
+	IPPU.TileCached[TILE_2BIT_EVEN][(t2 - 1) & (MAX_2BIT_TILES - 1)] = FALSE;
+	IPPU.TileCached[TILE_2BIT_ODD] [(t2 - 1) & (MAX_2BIT_TILES - 1)] = FALSE;
+	IPPU.TileCached[TILE_4BIT_EVEN][(t4 - 1) & (MAX_4BIT_TILES - 1)] = FALSE;
+	IPPU.TileCached[TILE_4BIT_ODD] [(t4 - 1) & (MAX_4BIT_TILES - 1)] = FALSE;
+	memset(IPPU.TileCached[TILE_2BIT_EVEN] + t2, FALSE, (last >> 4) - t2 + 1);
+	memset(IPPU.TileCached[TILE_2BIT_ODD]  + t2, FALSE, (last >> 4) - t2 + 1);
+	memset(IPPU.TileCached[TILE_4BIT_EVEN] + t4, FALSE, (last >> 5) - t4 + 1);
+	memset(IPPU.TileCached[TILE_4BIT_ODD]  + t4, FALSE, (last >> 5) - t4 + 1);
+}
+
+// VRAM writes only mark the 16 byte rows they touch in IPPU.VRAMDirtyRows.
+// The cached tiles over those rows are dropped here, before anything is drawn,
+// a run of marked rows at a time, however often each row was written.
+void S9xInvalidateDirtyTiles (void)
+{
+	uint32	r = 0;
+
+	while (r < 0x1000)
+	{
+		uint32	bits = IPPU.VRAMDirtyRows[r >> 5] >> (r & 31);
+
+		if (!bits)
+		{
+			r = (r | 31) + 1;
+			continue;
+		}
+
+		if (!(bits & 1))
+		{
+			r++;
+			continue;
+		}
+
+		uint32	first = r;
+
+		while (r < 0x1000 && (IPPU.VRAMDirtyRows[r >> 5] & (1 << (r & 31))))
+			r++;
+
+		InvalidateTiles(first << 4, (r - first) << 4);
+	}
+
+	for (int bg = 0; bg < 4; bg++)
+		InvalidateBGLines(&BGLineCache[bg]);
+
+	memset(IPPU.VRAMDirtyRows, 0, sizeof(IPPU.VRAMDirtyRows));
+	IPPU.VRAMDirty = FALSE;
+}
+
+// A write to the character data of any drawn row drops the whole layer, as
+// there is no telling which rows use the tile. A tilemap write only drops
+// the rows of its tilemap row.
+static void InvalidateBGLines (struct SBGLineCache *c)
+{
+	if (!c->Pixels)
+		return;
+
+	for (int i = 0; i < 128; i++)
+	{
+		if (IPPU.VRAMDirtyRows[i] & c->UsedChars[i])
+		{
+			memset(c->RowState, 0, sizeof(c->RowState));
+			memset(c->UsedChars, 0, sizeof(c->UsedChars));
+			return;
+		}
+	}
+
+	int	screens = 1 << ((c->SCSize & 1) + ((c->SCSize >> 1) & 1));
+	int	TileSizeV = c->BGSize ? 16 : 8;
+
+	for (int s = 0; s < screens; s++)
+	{
+		uint32	*dirty = &IPPU.VRAMDirtyRows[(((c->SCBase << 1) + (s << 11)) & 0xffff) >> 9];
+		int		half = ((c->SCSize == 2) ? s : (s >> 1)) & 1;
+
+		// 4 words of 32 rows of 16 bytes cover the 32x32 entries of a screen
+		for (int i = 0; i < 128; i++)
+		{
+			if (dirty[i >> 5] & (1 << (i & 31)))
+				memset(&c->RowState[((i >> 2) + (half << 5)) * TileSizeV], 0, TileSizeV);
+		}
+	}
+}
+
+// Called before each screen update is drawn, decides which layers are drawn
+// from their cache: those going through DrawBackground() with tiles of the
+// normal converters. A layer whose tilemap, character base or depth changed
+// starts over.
+void S9xSetupBGLineCache (void)
+{
+	int	layers;
+
+	switch (PPU.BGMode)
+	{
+		case 0:  layers = 4; break;
+		case 1:  layers = 3; break;
+		case 3:  layers = 2; break;
+		default: layers = 0; break;
+	}
+
+	for (int bg = 0; bg < 4; bg++)
+	{
+		struct SBGLineCache	*c = &BGLineCache[bg];
+
+		c->Enabled = FALSE;
+
+		if (!Settings.BGLineCache || IPPU.Interlace || bg >= layers)
+			continue;
+		if (PPU.BGMosaic[bg] && PPU.Mosaic > 1)
+			continue;
+		if (PPU.BGMode == 3 && bg == 0 && (Memory.FillRAM[0x2130] & 1))
+			continue;
+
+		if (!c->Pixels || c->BGMode != PPU.BGMode || c->SCBase != PPU.BG[bg].SCBase || c->SCSize != PPU.BG[bg].SCSize ||
+			c->NameBase != PPU.BG[bg].NameBase || c->BGSize != PPU.BG[bg].BGSize)
+		{
+			uint32	Width  = (SNES_WIDTH << (PPU.BG[bg].SCSize & 1)) << (PPU.BG[bg].BGSize ? 1 : 0);
+			uint32	Height = (SNES_WIDTH << ((PPU.BG[bg].SCSize >> 1) & 1)) << (PPU.BG[bg].BGSize ? 1 : 0);
+
+			if (Width * Height > c->Size)
+			{
+				free(c->Pixels);
+				c->Size = Width * Height;
+				c->Pixels = (uint8 *) malloc(c->Size);
+				if (!c->Pixels)
+				{
+					c->Size = 0;
+					continue;
+				}
+			}
+
+			c->BGMode   = PPU.BGMode;
+			c->SCBase   = PPU.BG[bg].SCBase;
+			c->SCSize   = PPU.BG[bg].SCSize;
+			c->NameBase = PPU.BG[bg].NameBase;
+			c->BGSize   = PPU.BG[bg].BGSize;
+			c->Width    = Width;
+			c->Height   = Height;
+			memset(c->RowState, 0, sizeof(c->RowState));
+			memset(c->UsedChars, 0, sizeof(c->UsedChars));
+		}
+
+		c->Enabled = TRUE;
+	}
+}
+
+// Draws row VPos of the layer, with the converter, palette and tile size
+// DrawBackground() was called with.
+static void BuildBGLine (struct SBG &BG, struct SBGLineCache *c, uint32 bg, uint32 VPos)
+{
+	uint16	*SC0, *SC1, *SC2, *SC3;
+
+	SC0 = (uint16 *) &Memory.VRAM[PPU.BG[bg].SCBase << 1];
+	SC1 = (PPU.BG[bg].SCSize & 1) ? SC0 + 1024 : SC0;
+	if (SC1 >= (uint16 *) (Memory.VRAM + 0x10000))
+		SC1 -= 0x8000;
+	SC2 = (PPU.BG[bg].SCSize & 2) ? SC1 + 1024 : SC0;
+	if (SC2 >= (uint16 *) (Memory.VRAM + 0x10000))
+		SC2 -= 0x8000;
+	SC3 = (PPU.BG[bg].SCSize & 1) ? SC2 + 1024 : SC2;
+	if (SC3 >= (uint16 *) (Memory.VRAM + 0x10000))
+		SC3 -= 0x8000;
+
+	uint32	TilemapRow = VPos >> ((BG.TileSizeV == 16) ? 4 : 3);
+	uint32	StartLine = (VPos & 7) << 3;
+	uint32	t1, t2;
+
+	if (VPos & 8)
+	{
+		t1 = 16;
+		t2 = 0;
+	}
+	else
+	{
+		t1 = 0;
+		t2 = 16;
+	}
+
+	uint16	*b1, *b2;
+
+	if (TilemapRow & 0x20)
+	{
+		b1 = SC2;
+		b2 = SC3;
+	}
+	else
+	{
+		b1 = SC0;
+		b2 = SC1;
+	}
+
+	b1 += (TilemapRow & 0x1f) << 5;
+	b2 += (TilemapRow & 0x1f) << 5;
+
+	uint32	CharBits = (1 << ((1 << BG.TileShift) >> 4)) - 1;
+	uint8	*p = c->Pixels + VPos * c->Width;
+
+	memset(c->Opaque[VPos], 0, sizeof(c->Opaque[VPos]));
+	memset(c->High[VPos], 0, sizeof(c->High[VPos]));
+
+	for (uint32 HTile = 0; HTile < c->Width >> 3; HTile++, p += 8)
+	{
+		uint16	*t;
+
+		if (BG.TileSizeH == 8)
+			t = (HTile > 31) ? b2 + (HTile & 0x1f) : b1 + HTile;
+		else
+			t = (HTile > 63) ? b2 + ((HTile >> 1) & 0x1f) : b1 + (HTile >> 1);
+
+		uint32	Tile = READ_WORD(t);
+
+		if (Tile & 0x2000)
+			c->High[VPos][HTile >> 5] |= 1 << (HTile & 31);
+
+		if (BG.TileSizeV == 16)
+			Tile = TILE_PLUS(Tile, ((Tile & V_FLIP) ? t2 : t1));
+		if (BG.TileSizeH == 16)
+			Tile = TILE_PLUS(Tile, ((Tile & H_FLIP) ? 1 - (HTile & 1) : (HTile & 1)));
+
+		uint32	TileAddr = (BG.TileAddress + ((Tile & 0x3ff) << BG.TileShift)) & 0xffff;
+	#ifdef USE_THREADS
+		__atomic_fetch_or(&c->UsedChars[TileAddr >> 9], CharBits << ((TileAddr >> 4) & 31), __ATOMIC_RELAXED);
+	#else
+		c->UsedChars[TileAddr >> 9] |= CharBits << ((TileAddr >> 4) & 31);
+	#endif
+
+		TileImpl::CachedTile	cache(BG, Tile);
+
+		cache.GetCachedTile();
+		if (cache.IsBlankTile())
+			continue;
+
+		uint8	*bp = cache.Ptr() + ((Tile & V_FLIP) ? 56 - StartLine : StartLine);
+		uint32	Palette = ((Tile >> BG.PaletteShift) & BG.PaletteMask) + BG.StartPalette;
+		uint32	any = 0;
+
+		for (int x = 0; x < 8; x++)
+		{
+			uint8	Pix = bp[(Tile & H_FLIP) ? 7 - x : x];
+			p[x] = Pix ? Pix + Palette : 0;
+			any |= Pix;
+		}
+
+		if (any)
+			c->Opaque[VPos][HTile >> 5] |= 1 << (HTile & 31);
+	}
+}
+
+// Makes sure every row lines BG.StartY to BG.EndY of the layer show is drawn.
+// With Settings.RenderThreads, bands showing the same row race for it like
+// for an unconverted tile.
+void S9xBuildBGLines (struct SBG &BG, uint32 bg)
+{
+	struct SBGLineCache	*c = &BGLineCache[bg];
+
+	for (uint32 Y = BG.StartY; Y <= BG.EndY; Y++)
+	{
+		uint32	VPos = (LineData[Y].BG[bg].VOffset + Y) & (c->Height - 1);
+
+	#ifdef USE_THREADS
+		uint8	state = __atomic_load_n(&c->RowState[VPos], __ATOMIC_ACQUIRE);
+		if (state == TRUE)
+			continue;
+
+		state = 0;
+		if (__atomic_compare_exchange_n(&c->RowState[VPos], &state, TILE_CONVERTING, false, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+		{
+			BuildBGLine(BG, c, bg, VPos);
+			__atomic_store_n(&c->RowState[VPos], TRUE, __ATOMIC_RELEASE);
+			continue;
+		}
+
+		while (state == TILE_CONVERTING)
+		{
+			std::this_thread::yield();
+			state = __atomic_load_n(&c->RowState[VPos], __ATOMIC_ACQUIRE);
+		}
+	#else
+		if (!c->RowState[VPos])
+		{
+			BuildBGLine(BG, c, bg, VPos);
+			c->RowState[VPos] = TRUE;
+		}
+	#endif
+	}
+}
+
+void S9xFreeBGLineCache (void)
+{
+	for (int bg = 0; bg < 4; bg++)
+	{
+		free(BGLineCache[bg].Pixels);
+		BGLineCache[bg].Pixels = NULL;
+		BGLineCache[bg].Size = 0;
+		BGLineCache[bg].Enabled = FALSE;
+	}
+}
+
 // Functions to select which converter and renderer to use.
 extern template struct TileImpl::Renderers<DrawTile16, Normal1x1>;
 extern template struct TileImpl::Renderers<DrawClippedTile16, Normal1x1>;
 extern template struct TileImpl::Renderers<DrawMosaicPixel16, Normal1x1>;
+extern template struct TileImpl::Renderers<DrawBackground16, Normal1x1>;
+extern template struct TileImpl::Renderers<DrawBGLines16, Normal1x1>;
 extern template struct TileImpl::Renderers<DrawBackdrop16, Normal1x1>;
 extern template struct TileImpl::Renderers<DrawMode7MosaicBG1, Normal1x1>;
 extern template struct TileImpl::Renderers<DrawMode7BG1, Normal1x1>;
@@ -309,6 +1133,8 @@ extern template struct TileImpl::Renderers<DrawMode7BG2, Normal1x1>;
 extern template struct TileImpl::Renderers<DrawTile16, Normal2x1>;
 extern template struct TileImpl::Renderers<DrawClippedTile16, Normal2x1>;
 extern template struct TileImpl::Renderers<DrawMosaicPixel16, Normal2x1>;
+extern template struct TileImpl::Renderers<DrawBackground16, Normal2x1>;
+extern template struct TileImpl::Renderers<DrawBGLines16, Normal2x1>;
 extern template struct TileImpl::Renderers<DrawBackdrop16, Normal2x1>;
 extern template struct TileImpl::Renderers<DrawMode7MosaicBG1, Normal2x1>;
 extern template struct TileImpl::Renderers<DrawMode7BG1, Normal2x1>;
@@ -317,10 +1143,14 @@ extern template struct TileImpl::Renderers<DrawMode7BG2, Normal2x1>;
 extern template struct TileImpl::Renderers<DrawTile16, Interlace>;
 extern template struct TileImpl::Renderers<DrawClippedTile16, Interlace>;
 extern template struct TileImpl::Renderers<DrawMosaicPixel16, Interlace>;
+extern template struct TileImpl::Renderers<DrawBackground16, Interlace>;
+extern template struct TileImpl::Renderers<DrawBGLines16, Interlace>;
 
 extern template struct TileImpl::Renderers<DrawTile16, Hires>;
 extern template struct TileImpl::Renderers<DrawClippedTile16, Hires>;
 extern template struct TileImpl::Renderers<DrawMosaicPixel16, Hires>;
+extern template struct TileImpl::Renderers<DrawBackground16, Hires>;
+extern template struct TileImpl::Renderers<DrawBGLines16, Hires>;
 extern template struct TileImpl::Renderers<DrawBackdrop16, Hires>;
 extern template struct TileImpl::Renderers<DrawMode7MosaicBG1, Hires>;
 extern template struct TileImpl::Renderers<DrawMode7BG1, Hires>;
@@ -329,86 +1159,104 @@ extern template struct TileImpl::Renderers<DrawMode7BG2, Hires>;
 extern template struct TileImpl::Renderers<DrawTile16, HiresInterlace>;
 extern template struct TileImpl::Renderers<DrawClippedTile16, HiresInterlace>;
 extern template struct TileImpl::Renderers<DrawMosaicPixel16, HiresInterlace>;
+extern template struct TileImpl::Renderers<DrawBackground16, HiresInterlace>;
+extern template struct TileImpl::Renderers<DrawBGLines16, HiresInterlace>;
 
-void S9xSelectTileRenderers (int BGMode, bool8 sub, bool8 obj)
+void S9xSelectTileRenderers (struct SBG &BG, int BGMode, bool8 sub, bool8 obj)
 {
-	void	(**DT)		(uint32, uint32, uint32, uint32);
-	void	(**DCT)		(uint32, uint32, uint32, uint32, uint32, uint32);
-	void	(**DMP)		(uint32, uint32, uint32, uint32, uint32, uint32);
-	void	(**DB)		(uint32, uint32, uint32);
-	void	(**DM7BG1)	(uint32, uint32, int);
-	void	(**DM7BG2)	(uint32, uint32, int);
+	void	(**DT)		(struct SBG &, uint32, uint32, uint32, uint32);
+	void	(**DCT)		(struct SBG &, uint32, uint32, uint32, uint32, uint32, uint32);
+	void	(**DMP)		(struct SBG &, uint32, uint32, uint32, uint32, uint32, uint32);
+	void	(**DBG)		(struct SBG &, uint32, uint8, uint8, uint32);
+	void	(**DBL)		(struct SBG &, uint32, uint8, uint8, uint32);
+	void	(**DB)		(struct SBG &, uint32, uint32, uint32);
+	void	(**DM7BG1)	(struct SBG &, uint32, uint32, int);
+	void	(**DM7BG2)	(struct SBG &, uint32, uint32, int);
 	bool8	M7M1, M7M2;
 
 	M7M1 = PPU.BGMosaic[0] && PPU.Mosaic > 1;
 	M7M2 = PPU.BGMosaic[1] && PPU.Mosaic > 1;
 
+	int	f = S9xPixelFormat555() ? 1 : 0;
+
 	bool8 interlace = obj ? FALSE : IPPU.Interlace;
 	bool8 hires = !sub && (BGMode == 5 || BGMode == 6 || IPPU.PseudoHires);
 
 	if (!IPPU.DoubleWidthPixels)	// normal width
 	{
-		DT     = Renderers<DrawTile16, Normal1x1>::Functions;
-		DCT    = Renderers<DrawClippedTile16, Normal1x1>::Functions;
-		DMP    = Renderers<DrawMosaicPixel16, Normal1x1>::Functions;
-		DB     = Renderers<DrawBackdrop16, Normal1x1>::Functions;
-		DM7BG1 = M7M1 ? Renderers<DrawMode7MosaicBG1, Normal1x1>::Functions : Renderers<DrawMode7BG1, Normal1x1>::Functions;
-		DM7BG2 = M7M2 ? Renderers<DrawMode7MosaicBG2, Normal1x1>::Functions : Renderers<DrawMode7BG2, Normal1x1>::Functions;
-		GFX.LinesPerTile = 8;
+		DT     = Renderers<DrawTile16, Normal1x1>::Functions[f];
+		DCT    = Renderers<DrawClippedTile16, Normal1x1>::Functions[f];
+		DMP    = Renderers<DrawMosaicPixel16, Normal1x1>::Functions[f];
+		DBG    = Renderers<DrawBackground16, Normal1x1>::Functions[f];
+		DBL    = Renderers<DrawBGLines16, Normal1x1>::Functions[f];
+		DB     = Renderers<DrawBackdrop16, Normal1x1>::Functions[f];
+		DM7BG1 = M7M1 ? Renderers<DrawMode7MosaicBG1, Normal1x1>::Functions[f] : Renderers<DrawMode7BG1, Normal1x1>::Functions[f];
+		DM7BG2 = M7M2 ? Renderers<DrawMode7MosaicBG2, Normal1x1>::Functions[f] : Renderers<DrawMode7BG2, Normal1x1>::Functions[f];
+		BG.LinesPerTile = 8;
 	}
 	else if(hires)					// hires double width
 	{
 		if (interlace)
 		{
-			DT     = Renderers<DrawTile16, HiresInterlace>::Functions;
-			DCT    = Renderers<DrawClippedTile16, HiresInterlace>::Functions;
-			DMP    = Renderers<DrawMosaicPixel16, HiresInterlace>::Functions;
-			DB     = Renderers<DrawBackdrop16, Hires>::Functions;
-			DM7BG1 = M7M1 ? Renderers<DrawMode7MosaicBG1, Hires>::Functions : Renderers<DrawMode7BG1, Hires>::Functions;
-			DM7BG2 = M7M2 ? Renderers<DrawMode7MosaicBG2, Hires>::Functions : Renderers<DrawMode7BG2, Hires>::Functions;
-			GFX.LinesPerTile = 4;
+			DT     = Renderers<DrawTile16, HiresInterlace>::Functions[f];
+			DCT    = Renderers<DrawClippedTile16, HiresInterlace>::Functions[f];
+			DMP    = Renderers<DrawMosaicPixel16, HiresInterlace>::Functions[f];
+			DBG    = Renderers<DrawBackground16, HiresInterlace>::Functions[f];
+			DBL    = Renderers<DrawBGLines16, HiresInterlace>::Functions[f];
+			DB     = Renderers<DrawBackdrop16, Hires>::Functions[f];
+			DM7BG1 = M7M1 ? Renderers<DrawMode7MosaicBG1, Hires>::Functions[f] : Renderers<DrawMode7BG1, Hires>::Functions[f];
+			DM7BG2 = M7M2 ? Renderers<DrawMode7MosaicBG2, Hires>::Functions[f] : Renderers<DrawMode7BG2, Hires>::Functions[f];
+			BG.LinesPerTile = 4;
 		}
 		else
 		{
-			DT     = Renderers<DrawTile16, Hires>::Functions;
-			DCT    = Renderers<DrawClippedTile16, Hires>::Functions;
-			DMP    = Renderers<DrawMosaicPixel16, Hires>::Functions;
-			DB     = Renderers<DrawBackdrop16, Hires>::Functions;
-			DM7BG1 = M7M1 ? Renderers<DrawMode7MosaicBG1, Hires>::Functions : Renderers<DrawMode7BG1, Hires>::Functions;
-			DM7BG2 = M7M2 ? Renderers<DrawMode7MosaicBG2, Hires>::Functions : Renderers<DrawMode7BG2, Hires>::Functions;
-			GFX.LinesPerTile = 8;
+			DT     = Renderers<DrawTile16, Hires>::Functions[f];
+			DCT    = Renderers<DrawClippedTile16, Hires>::Functions[f];
+			DMP    = Renderers<DrawMosaicPixel16, Hires>::Functions[f];
+			DBG    = Renderers<DrawBackground16, Hires>::Functions[f];
+			DBL    = Renderers<DrawBGLines16, Hires>::Functions[f];
+			DB     = Renderers<DrawBackdrop16, Hires>::Functions[f];
+			DM7BG1 = M7M1 ? Renderers<DrawMode7MosaicBG1, Hires>::Functions[f] : Renderers<DrawMode7BG1, Hires>::Functions[f];
+			DM7BG2 = M7M2 ? Renderers<DrawMode7MosaicBG2, Hires>::Functions[f] : Renderers<DrawMode7BG2, Hires>::Functions[f];
+			BG.LinesPerTile = 8;
 		}
 	}
 	else							// normal double width
 	{
 		if (interlace)
 		{
-			DT     = Renderers<DrawTile16, Interlace>::Functions;
-			DCT    = Renderers<DrawClippedTile16, Interlace>::Functions;
-			DMP    = Renderers<DrawMosaicPixel16, Interlace>::Functions;
-			DB     = Renderers<DrawBackdrop16, Normal2x1>::Functions;
-			DM7BG1 = M7M1 ? Renderers<DrawMode7MosaicBG1, Normal2x1>::Functions : Renderers<DrawMode7BG1, Normal2x1>::Functions;
-			DM7BG2 = M7M2 ? Renderers<DrawMode7MosaicBG2, Normal2x1>::Functions : Renderers<DrawMode7BG2, Normal2x1>::Functions;
-			GFX.LinesPerTile = 4;
+			DT     = Renderers<DrawTile16, Interlace>::Functions[f];
+			DCT    = Renderers<DrawClippedTile16, Interlace>::Functions[f];
+			DMP    = Renderers<DrawMosaicPixel16, Interlace>::Functions[f];
+			DBG    = Renderers<DrawBackground16, Interlace>::Functions[f];
+			DBL    = Renderers<DrawBGLines16, Interlace>::Functions[f];
+			DB     = Renderers<DrawBackdrop16, Normal2x1>::Functions[f];
+			DM7BG1 = M7M1 ? Renderers<DrawMode7MosaicBG1, Normal2x1>::Functions[f] : Renderers<DrawMode7BG1, Normal2x1>::Functions[f];
+			DM7BG2 = M7M2 ? Renderers<DrawMode7MosaicBG2, Normal2x1>::Functions[f] : Renderers<DrawMode7BG2, Normal2x1>::Functions[f];
+			BG.LinesPerTile = 4;
 		}
 		else
 		{
-			DT     = Renderers<DrawTile16, Normal2x1>::Functions;
-			DCT    = Renderers<DrawClippedTile16, Normal2x1>::Functions;
-			DMP    = Renderers<DrawMosaicPixel16, Normal2x1>::Functions;
-			DB     = Renderers<DrawBackdrop16, Normal2x1>::Functions;
-			DM7BG1 = M7M1 ? Renderers<DrawMode7MosaicBG1, Normal2x1>::Functions : Renderers<DrawMode7BG1, Normal2x1>::Functions;
-			DM7BG2 = M7M2 ? Renderers<DrawMode7MosaicBG2, Normal2x1>::Functions : Renderers<DrawMode7BG2, Normal2x1>::Functions;
-			GFX.LinesPerTile = 8;
+			DT     = Renderers<DrawTile16, Normal2x1>::Functions[f];
+			DCT    = Renderers<DrawClippedTile16, Normal2x1>::Functions[f];
+			DMP    = Renderers<DrawMosaicPixel16, Normal2x1>::Functions[f];
+			DBG    = Renderers<DrawBackground16, Normal2x1>::Functions[f];
+			DBL    = Renderers<DrawBGLines16, Normal2x1>::Functions[f];
+			DB     = Renderers<DrawBackdrop16, Normal2x1>::Functions[f];
+			DM7BG1 = M7M1 ? Renderers<DrawMode7MosaicBG1, Normal2x1>::Functions[f] : Renderers<DrawMode7BG1, Normal2x1>::Functions[f];
+			DM7BG2 = M7M2 ? Renderers<DrawMode7MosaicBG2, Normal2x1>::Functions[f] : Renderers<DrawMode7BG2, Normal2x1>::Functions[f];
+			BG.LinesPerTile = 8;
 		}
 	}
 
-	GFX.DrawTileNomath        = DT[0];
-	GFX.DrawClippedTileNomath = DCT[0];
-	GFX.DrawMosaicPixelNomath = DMP[0];
-	GFX.DrawBackdropNomath    = DB[0];
-	GFX.DrawMode7BG1Nomath    = DM7BG1[0];
-	GFX.DrawMode7BG2Nomath    = DM7BG2[0];
+	BG.DrawTileNomath        = DT[0];
+	BG.DrawClippedTileNomath = DCT[0];
+	BG.DrawMosaicPixelNomath = DMP[0];
+	BG.DrawBackgroundNomath  = DBG[0];
+	BG.DrawBGLinesNomath     = DBL[0];
+	BG.DrawBackdropNomath    = DB[0];
+	BG.DrawMode7BG1Nomath    = DM7BG1[0];
+	BG.DrawMode7BG2Nomath    = DM7BG2[0];
 
 	int	i;
 
@@ -433,15 +1281,40 @@ void S9xSelectTileRenderers (int BGMode, bool8 sub, bool8 obj)
 
 	}
 
-	GFX.DrawTileMath        = DT[i];
-	GFX.DrawClippedTileMath = DCT[i];
-	GFX.DrawMosaicPixelMath = DMP[i];
-	GFX.DrawBackdropMath    = DB[i];
-	GFX.DrawMode7BG1Math    = DM7BG1[i];
-	GFX.DrawMode7BG2Math    = DM7BG2[i];
+#ifdef TILE_SSE2
+	// Leave the math of the main screen to S9xComposeMath, which blends whole
+	// lines once all layers are drawn. The hires plotter needs the neighbouring
+	// main screen pixel, so it still does its math while drawing.
+	if (!sub)
+		BG.DeferredMath = 0;
+
+	if (!sub && i && !(IPPU.DoubleWidthPixels && hires))
+	{
+		BG.DeferredMath = i;
+		i = 10;
+
+		BG.DrawTileNomath        = DT[9];
+		BG.DrawClippedTileNomath = DCT[9];
+		BG.DrawMosaicPixelNomath = DMP[9];
+		BG.DrawBackgroundNomath  = DBG[9];
+		BG.DrawBGLinesNomath     = DBL[9];
+		BG.DrawBackdropNomath    = DB[9];
+		BG.DrawMode7BG1Nomath    = DM7BG1[9];
+		BG.DrawMode7BG2Nomath    = DM7BG2[9];
+	}
+#endif
+
+	BG.DrawTileMath        = DT[i];
+	BG.DrawClippedTileMath = DCT[i];
+	BG.DrawMosaicPixelMath = DMP[i];
+	BG.DrawBackgroundMath  = DBG[i];
+	BG.DrawBGLinesMath     = DBL[i];
+	BG.DrawBackdropMath    = DB[i];
+	BG.DrawMode7BG1Math    = DM7BG1[i];
+	BG.DrawMode7BG2Math    = DM7BG2[i];
 }
 
-void S9xSelectTileConverter (int depth, bool8 hires, bool8 sub, bool8 mosaic)
+void S9xSelectTileConverter (struct SBG &BG, int depth, bool8 hires, bool8 sub, bool8 mosaic)
 {
 	switch (depth)
 	{
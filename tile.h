@@ -8,7 +8,17 @@
 #define _TILE_H_
 
 void S9xInitTileRenderer (void);
-void S9xSelectTileRenderers (int, bool8, bool8);
-void S9xSelectTileConverter (int, bool8, bool8, bool8);
+void S9xSelectTileRenderers (struct SBG &, int, bool8, bool8);
+void S9xSelectTileConverter (struct SBG &, int, bool8, bool8, bool8);
+void S9xComposeMath (struct SBG &);
+void S9xInvalidateDirtyTiles (void);
+void S9xSetupBGLineCache (void);
+void S9xBuildBGLines (struct SBG &, uint32);
+void S9xFreeBGLineCache (void);
+void S9xFetchMode7Pixels (uint8 *, int, int32, int32, int32, int32);
+void S9xConvertPixels32 (uint32 *, const uint16 *, int);
+#ifdef USE_THREADS
+uint8 S9xConvertTileShared (uint8 *, uint8 (*) (uint8 *, uint32, uint32), uint8 *, uint32, uint32);
+#endif
 
 #endif
@@ -10,13 +10,14 @@
 namespace TileImpl {
 
 	template<class MATH, class BPSTART>
-	void Normal1x1Base<MATH, BPSTART>::Draw(int N, int M, uint32 Offset, uint32 OffsetInLine, uint8 Pix, uint8 Z1, uint8 Z2)
+	void Normal1x1Base<MATH, BPSTART>::Draw(struct SBG &BG, int N, int M, uint32 Offset, uint32 OffsetInLine, uint8 Pix, uint8 Z1, uint8 Z2)
 	{
 		(void) OffsetInLine;
-		if (Z1 > GFX.DB[Offset + N] && (M))
+		if (Z1 > BG.DB[Offset + N] && (M))
 		{
-			GFX.S[Offset + N] = MATH::Calc(GFX.ScreenColors[Pix], GFX.SubScreen[Offset + N], GFX.SubZBuffer[Offset + N]);
-			GFX.DB[Offset + N] = Z2;
+			BG.S[Offset + N] = MATH::Calc(BG, BG.ScreenColors[Pix], GFX.SubScreen[Offset + N], GFX.SubZBuffer[Offset + N]);
+			BG.DB[Offset + N] = Z2;
+			MATH::Mark(BG, Offset + N);
 		}
 	}
 
@@ -25,6 +26,8 @@ namespace TileImpl {
 	template struct Renderers<DrawTile16, Normal1x1>;
 	template struct Renderers<DrawClippedTile16, Normal1x1>;
 	template struct Renderers<DrawMosaicPixel16, Normal1x1>;
+	template struct Renderers<DrawBackground16, Normal1x1>;
+	template struct Renderers<DrawBGLines16, Normal1x1>;
 	template struct Renderers<DrawBackdrop16, Normal1x1>;
 	template struct Renderers<DrawMode7MosaicBG1, Normal1x1>;
 	template struct Renderers<DrawMode7BG1, Normal1x1>;
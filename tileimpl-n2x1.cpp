@@ -10,13 +10,15 @@
 namespace TileImpl {
 
 	template<class MATH, class BPSTART>
-	void Normal2x1Base<MATH, BPSTART>::Draw(int N, int M, uint32 Offset, uint32 OffsetInLine, uint8 Pix, uint8 Z1, uint8 Z2)
+	void Normal2x1Base<MATH, BPSTART>::Draw(struct SBG &BG, int N, int M, uint32 Offset, uint32 OffsetInLine, uint8 Pix, uint8 Z1, uint8 Z2)
 	{
 		(void) OffsetInLine;
-		if (Z1 > GFX.DB[Offset + 2 * N] && (M))
+		if (Z1 > BG.DB[Offset + 2 * N] && (M))
 		{
-			GFX.S[Offset + 2 * N] = GFX.S[Offset + 2 * N + 1] = MATH::Calc(GFX.ScreenColors[Pix], GFX.SubScreen[Offset + 2 * N], GFX.SubZBuffer[Offset + 2 * N]);
-			GFX.DB[Offset + 2 * N] = GFX.DB[Offset + 2 * N + 1] = Z2;
+			BG.S[Offset + 2 * N] = BG.S[Offset + 2 * N + 1] = MATH::Calc(BG, BG.ScreenColors[Pix], GFX.SubScreen[Offset + 2 * N], GFX.SubZBuffer[Offset + 2 * N]);
+			BG.DB[Offset + 2 * N] = BG.DB[Offset + 2 * N + 1] = Z2;
+			MATH::Mark(BG, Offset + 2 * N);
+			MATH::Mark(BG, Offset + 2 * N + 1);
 		}
 	}
 
@@ -25,6 +27,8 @@ namespace TileImpl {
 	template struct Renderers<DrawTile16, Normal2x1>;
 	template struct Renderers<DrawClippedTile16, Normal2x1>;
 	template struct Renderers<DrawMosaicPixel16, Normal2x1>;
+	template struct Renderers<DrawBackground16, Normal2x1>;
+	template struct Renderers<DrawBGLines16, Normal2x1>;
 	template struct Renderers<DrawBackdrop16, Normal2x1>;
 	template struct Renderers<DrawMode7MosaicBG1, Normal2x1>;
 	template struct Renderers<DrawMode7BG1, Normal2x1>;
@@ -35,6 +39,8 @@ namespace TileImpl {
 	template struct Renderers<DrawTile16, Interlace>;
 	template struct Renderers<DrawClippedTile16, Interlace>;
 	template struct Renderers<DrawMosaicPixel16, Interlace>;
+	template struct Renderers<DrawBackground16, Interlace>;
+	template struct Renderers<DrawBGLines16, Interlace>;
 	//template struct Renderers<DrawBackdrop16, Normal2x1>;
 	//template struct Renderers<DrawMode7MosaicBG1, Normal2x1>;
 	//template struct Renderers<DrawMode7BG1, Normal2x1>;
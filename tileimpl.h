@@ -11,6 +11,12 @@
 #include "ppu.h"
 #include "tile.h"
 
+#if defined(__SSE2__) || defined(_M_X64)
+	#include <emmintrin.h>
+	#define TILE_SSE2 1
+#endif
+
+extern struct SLineData			LineData[240];
 extern struct SLineMatrixData	LineMatrixData[240];
 
 
@@ -19,7 +25,7 @@ namespace TileImpl {
 	struct BPProgressive
 	{
 		enum { Pitch = 1 };
-		static alwaysinline uint32 Get(uint32 StartLine) { return StartLine; }
+		static alwaysinline uint32 Get(struct SBG &, uint32 StartLine) { return StartLine; }
 	};
 
 	// Interlace: Only draw every other line, so we'll redefine bpstart_t and Pitch to do so.
@@ -27,7 +33,7 @@ namespace TileImpl {
 	struct BPInterlace
 	{
 		enum { Pitch = 2 };
-		static alwaysinline uint32 Get(uint32 StartLine) { return StartLine * 2 + BG.InterlaceLine; }
+		static alwaysinline uint32 Get(struct SBG &BG, uint32 StartLine) { return StartLine * 2 + BG.InterlaceLine; }
 	};
 
 
@@ -38,7 +44,7 @@ namespace TileImpl {
 		enum { Pitch = BPSTART::Pitch };
 		typedef BPSTART bpstart_t;
 
-		static void Draw(int N, int M, uint32 Offset, uint32 OffsetInLine, uint8 Pix, uint8 Z1, uint8 Z2);
+		static void Draw(struct SBG &BG, int N, int M, uint32 Offset, uint32 OffsetInLine, uint8 Pix, uint8 Z1, uint8 Z2);
 	};
 
 	template<class MATH>
@@ -52,7 +58,7 @@ namespace TileImpl {
 		enum { Pitch = BPSTART::Pitch };
 		typedef BPSTART bpstart_t;
 
-		static void Draw(int N, int M, uint32 Offset, uint32 OffsetInLine, uint8 Pix, uint8 Z1, uint8 Z2);
+		static void Draw(struct SBG &BG, int N, int M, uint32 Offset, uint32 OffsetInLine, uint8 Pix, uint8 Z1, uint8 Z2);
 	};
 
 	template<class MATH>
@@ -75,7 +81,7 @@ namespace TileImpl {
 		enum { Pitch = BPSTART::Pitch };
 		typedef BPSTART bpstart_t;
 
-		static void Draw(int N, int M, uint32 Offset, uint32 OffsetInLine, uint8 Pix, uint8 Z1, uint8 Z2);
+		static void Draw(struct SBG &BG, int N, int M, uint32 Offset, uint32 OffsetInLine, uint8 Pix, uint8 Z1, uint8 Z2);
 	};
 
 	template<class MATH>
@@ -87,7 +93,7 @@ namespace TileImpl {
 	class CachedTile
 	{
 	public:
-		CachedTile(uint32 tile) : Tile(tile) {}
+		CachedTile(struct SBG &bg, uint32 tile) : BG(bg), Tile(tile) {}
 
 		alwaysinline void GetCachedTile()
 		{
@@ -99,31 +105,29 @@ namespace TileImpl {
 			if (Tile & H_FLIP)
 			{
 				pCache = &BG.BufferFlip[TileNumber << 6];
-				if (!BG.BufferedFlip[TileNumber])
-					BG.BufferedFlip[TileNumber] = BG.ConvertTileFlip(pCache, TileAddr, Tile & 0x3ff);
+				State = FetchTile(&BG.BufferedFlip[TileNumber], BG.ConvertTileFlip);
 			}
 			else
 			{
 				pCache = &BG.Buffer[TileNumber << 6];
-				if (!BG.Buffered[TileNumber])
-					BG.Buffered[TileNumber] = BG.ConvertTile(pCache, TileAddr, Tile & 0x3ff);
+				State = FetchTile(&BG.Buffered[TileNumber], BG.ConvertTile);
 			}
 		}
 
 		alwaysinline bool IsBlankTile() const
 		{
-			return ((Tile & H_FLIP) ? BG.BufferedFlip[TileNumber] : BG.Buffered[TileNumber]) == BLANK_TILE;
+			return State == BLANK_TILE;
 		}
 
 		alwaysinline void SelectPalette() const
 		{
 			if (BG.DirectColourMode)
 			{
-				GFX.RealScreenColors = DirectColourMaps[(Tile >> 10) & 7];
+				BG.RealScreenColors = DirectColourMaps[(Tile >> 10) & 7];
 			}
 			else
-				GFX.RealScreenColors = &IPPU.ScreenColors[((Tile >> BG.PaletteShift) & BG.PaletteMask) + BG.StartPalette];
-			GFX.ScreenColors = GFX.ClipColors ? BlackColourMap : GFX.RealScreenColors;
+				BG.RealScreenColors = &IPPU.ScreenColors[((Tile >> BG.PaletteShift) & BG.PaletteMask) + BG.StartPalette];
+			BG.ScreenColors = BG.ClipColors ? BlackColourMap : BG.RealScreenColors;
 		}
 
 		alwaysinline uint8* Ptr() const
@@ -132,16 +136,41 @@ namespace TileImpl {
 		}
 
 	private:
+		alwaysinline uint8 FetchTile(uint8 *Buffered, uint8 (*Convert) (uint8 *, uint32, uint32))
+		{
+		#ifdef USE_THREADS
+			uint8	state = __atomic_load_n(Buffered, __ATOMIC_ACQUIRE);
+			if (state == TRUE || state == BLANK_TILE)
+				return state;
+			return S9xConvertTileShared(Buffered, Convert, pCache, TileAddr, Tile & 0x3ff);
+		#else
+			if (!*Buffered)
+				*Buffered = Convert(pCache, TileAddr, Tile & 0x3ff);
+			return *Buffered;
+		#endif
+		}
+
+		struct SBG &BG;
 		uint8  *pCache;
+		uint8  State;
 		uint32 Tile;
 		uint32 TileNumber;
 		uint32 TileAddr;
 	};
 
 
-	struct NOMATH
+	// Math done while drawing leaves nothing for S9xComposeMath to do.
+	struct INLINEMATH
 	{
-		static alwaysinline uint16 Calc(uint16 Main, uint16 Sub, uint8 SD)
+		enum { Plain = 0, Marks = 0 };
+		static alwaysinline uint8 MarkValue(struct SBG &) { return 0; }
+		static alwaysinline void Mark(struct SBG &, uint32 Offset) {}
+	};
+
+	struct NOMATH : public INLINEMATH
+	{
+		enum { Plain = 1 };
+		static alwaysinline uint16 Calc(struct SBG &, uint16 Main, uint16 Sub, uint8 SD)
 		{
 			return Main;
 		}
@@ -149,40 +178,73 @@ namespace TileImpl {
 	typedef NOMATH Blend_None;
 
 	template<class Op>
-	struct REGMATH
+	struct REGMATH : public INLINEMATH
 	{
-		static alwaysinline uint16 Calc(uint16 Main, uint16 Sub, uint8 SD)
+		static alwaysinline uint16 Calc(struct SBG &, uint16 Main, uint16 Sub, uint8 SD)
 		{
 			return Op::fn(Main, (SD & 0x20) ? Sub : GFX.FixedColour);
 		}
 	};
-	typedef REGMATH<COLOR_ADD> Blend_Add;
-	typedef REGMATH<COLOR_SUB> Blend_Sub;
-	typedef REGMATH<COLOR_ADD_BRIGHTNESS> Blend_AddBrightness;
 
 	template<class Op>
-	struct MATHF1_2
+	struct MATHF1_2 : public INLINEMATH
 	{
-		static alwaysinline uint16 Calc(uint16 Main, uint16 Sub, uint8 SD)
+		static alwaysinline uint16 Calc(struct SBG &BG, uint16 Main, uint16 Sub, uint8 SD)
 		{
-			return GFX.ClipColors ? Op::fn(Main, GFX.FixedColour) : Op::fn1_2(Main, GFX.FixedColour);
+			return BG.ClipColors ? Op::fn(Main, GFX.FixedColour) : Op::fn1_2(Main, GFX.FixedColour);
 		}
 	};
-	typedef MATHF1_2<COLOR_ADD> Blend_AddF1_2;
-	typedef MATHF1_2<COLOR_SUB> Blend_SubF1_2;
 
 	template<class Op>
-	struct MATHS1_2
+	struct MATHS1_2 : public INLINEMATH
 	{
-		static alwaysinline uint16 Calc(uint16 Main, uint16 Sub, uint8 SD)
+		static alwaysinline uint16 Calc(struct SBG &BG, uint16 Main, uint16 Sub, uint8 SD)
 		{
-			return GFX.ClipColors ? REGMATH<Op>::Calc(Main, Sub, SD) : (SD & 0x20) ? Op::fn1_2(Main, Sub) : Op::fn(Main, GFX.FixedColour);
+			return BG.ClipColors ? REGMATH<Op>::Calc(BG, Main, Sub, SD) : (SD & 0x20) ? Op::fn1_2(Main, Sub) : Op::fn(Main, GFX.FixedColour);
 		}
 	};
-	typedef MATHS1_2<COLOR_ADD> Blend_AddS1_2;
-	typedef MATHS1_2<COLOR_SUB> Blend_SubS1_2;
-	typedef MATHS1_2<COLOR_ADD_BRIGHTNESS> Blend_AddS1_2Brightness;
 
+	// The blending modes with math, for pixel format F
+	template<class F>
+	struct Blend
+	{
+		typedef REGMATH< COLOR_ADD_T<F> > Add;
+		typedef REGMATH< COLOR_SUB_T<F> > Sub;
+		typedef REGMATH< COLOR_ADD_BRIGHTNESS_T<F> > AddBrightness;
+		typedef MATHF1_2< COLOR_ADD_T<F> > AddF1_2;
+		typedef MATHF1_2< COLOR_SUB_T<F> > SubF1_2;
+		typedef MATHS1_2< COLOR_ADD_T<F> > AddS1_2;
+		typedef MATHS1_2< COLOR_SUB_T<F> > SubS1_2;
+		typedef MATHS1_2< COLOR_ADD_BRIGHTNESS_T<F> > AddS1_2Brightness;
+	};
+
+	// Math left for S9xComposeMath: the main screen gets the unblended color and
+	// GFX.MathBuffer says whether the pixel is to be blended, 1, or blended with
+	// color window clipping, 3. Pixels drawn without math get a 0.
+	template<bool Math>
+	struct DEFERMATH
+	{
+		enum { Plain = 1, Marks = 1 };
+
+		static alwaysinline uint16 Calc(struct SBG &, uint16 Main, uint16 Sub, uint8 SD)
+		{
+			return Main;
+		}
+
+		static alwaysinline uint8 MarkValue(struct SBG &BG)
+		{
+			return Math ? (BG.ClipColors ? 3 : 1) : 0;
+		}
+
+		static alwaysinline void Mark(struct SBG &BG, uint32 Offset)
+		{
+			GFX.MathBuffer[Offset] = MarkValue(BG);
+		}
+	};
+	typedef DEFERMATH<false> Blend_NoneDeferred;
+	typedef DEFERMATH<true> Blend_Deferred;
+
+	// Functions[0] is for RGB565 and Functions[1] for RGB555.
 	template<
 		template<class PIXEL_> class TILE,
 		template<class MATH> class PIXEL
@@ -192,26 +254,36 @@ namespace TileImpl {
 		enum { Pitch = PIXEL<Blend_None>::Pitch };
 		typedef typename TILE< PIXEL<Blend_None> >::call_t call_t;
 
-		static call_t Functions[9];
+		static call_t Functions[2][11];
 	};
 
 	#ifdef _TILEIMPL_CPP_
+	#define RENDERERS_FOR(F) \
+	{ \
+		TILE< PIXEL<Blend_None> >::Draw, \
+		TILE< PIXEL<typename Blend<F>::Add> >::Draw, \
+		TILE< PIXEL<typename Blend<F>::AddF1_2> >::Draw, \
+		TILE< PIXEL<typename Blend<F>::AddS1_2> >::Draw, \
+		TILE< PIXEL<typename Blend<F>::Sub> >::Draw, \
+		TILE< PIXEL<typename Blend<F>::SubF1_2> >::Draw, \
+		TILE< PIXEL<typename Blend<F>::SubS1_2> >::Draw, \
+		TILE< PIXEL<typename Blend<F>::AddBrightness> >::Draw, \
+		TILE< PIXEL<typename Blend<F>::AddS1_2Brightness> >::Draw, \
+		TILE< PIXEL<Blend_NoneDeferred> >::Draw, \
+		TILE< PIXEL<Blend_Deferred> >::Draw, \
+	}
+
 	template<
 		template<class PIXEL_> class TILE,
 		template<class MATH> class PIXEL
 	>
-	typename Renderers<TILE, PIXEL>::call_t Renderers<TILE, PIXEL>::Functions[9] =
+	typename Renderers<TILE, PIXEL>::call_t Renderers<TILE, PIXEL>::Functions[2][11] =
 	{
-		TILE< PIXEL<Blend_None> >::Draw,
-		TILE< PIXEL<Blend_Add> >::Draw,
-		TILE< PIXEL<Blend_AddF1_2> >::Draw,
-		TILE< PIXEL<Blend_AddS1_2> >::Draw,
-		TILE< PIXEL<Blend_Sub> >::Draw,
-		TILE< PIXEL<Blend_SubF1_2> >::Draw,
-		TILE< PIXEL<Blend_SubS1_2> >::Draw,
-		TILE< PIXEL<Blend_AddBrightness> >::Draw,
-		TILE< PIXEL<Blend_AddS1_2Brightness> >::Draw,
+		RENDERERS_FOR(PIXEL_RGB565),
+		RENDERERS_FOR(PIXEL_RGB555)
 	};
+
+	#undef RENDERERS_FOR
 	#endif
 
 	// Basic routine to render an unclipped tile.
@@ -227,21 +299,21 @@ namespace TileImpl {
 
 	#define OFFSET_IN_LINE \
 		uint32 OffsetInLine = Offset % GFX.RealPPL;
-	#define DRAW_PIXEL(N, M) PIXEL::Draw(N, M, Offset, OffsetInLine, Pix, Z1, Z2)
-	#define Z1	GFX.Z1
-	#define Z2	GFX.Z2
+	#define DRAW_PIXEL(N, M) PIXEL::Draw(BG, N, M, Offset, OffsetInLine, Pix, Z1, Z2)
+	#define Z1	BG.Z1
+	#define Z2	BG.Z2
 
 	template<class PIXEL>
 	struct DrawTile16
 	{
-		typedef void (*call_t)(uint32, uint32, uint32, uint32);
+		typedef void (*call_t)(struct SBG &, uint32, uint32, uint32, uint32);
 
 		enum { Pitch = PIXEL::Pitch };
 		typedef typename PIXEL::bpstart_t bpstart_t;
 
-		static void Draw(uint32 Tile, uint32 Offset, uint32 StartLine, uint32 LineCount)
+		static void Draw(struct SBG &BG, uint32 Tile, uint32 Offset, uint32 StartLine, uint32 LineCount)
 		{
-			CachedTile cache(Tile);
+			CachedTile cache(BG, Tile);
 			int32	l;
 			uint8	*bp, Pix;
 
@@ -252,7 +324,7 @@ namespace TileImpl {
 
 			if (!(Tile & (V_FLIP | H_FLIP)))
 			{
-				bp = cache.Ptr() + bpstart_t::Get(StartLine);
+				bp = cache.Ptr() + bpstart_t::Get(BG, StartLine);
 				OFFSET_IN_LINE;
 				for (l = LineCount; l > 0; l--, bp += 8 * Pitch, Offset += GFX.PPL)
 				{
@@ -264,7 +336,7 @@ namespace TileImpl {
 			else
 			if (!(Tile & V_FLIP))
 			{
-				bp = cache.Ptr() + bpstart_t::Get(StartLine);
+				bp = cache.Ptr() + bpstart_t::Get(BG, StartLine);
 				OFFSET_IN_LINE;
 				for (l = LineCount; l > 0; l--, bp += 8 * Pitch, Offset += GFX.PPL)
 				{
@@ -276,7 +348,7 @@ namespace TileImpl {
 			else
 			if (!(Tile & H_FLIP))
 			{
-				bp = cache.Ptr() + 56 - bpstart_t::Get(StartLine);
+				bp = cache.Ptr() + 56 - bpstart_t::Get(BG, StartLine);
 				OFFSET_IN_LINE;
 				for (l = LineCount; l > 0; l--, bp -= 8 * Pitch, Offset += GFX.PPL)
 				{
@@ -287,7 +359,7 @@ namespace TileImpl {
 			}
 			else
 			{
-				bp = cache.Ptr() + 56 - bpstart_t::Get(StartLine);
+				bp = cache.Ptr() + 56 - bpstart_t::Get(BG, StartLine);
 				OFFSET_IN_LINE;
 				for (l = LineCount; l > 0; l--, bp -= 8 * Pitch, Offset += GFX.PPL)
 				{
@@ -304,20 +376,20 @@ namespace TileImpl {
 
 	// Basic routine to render a clipped tile. Inputs same as above.
 
-	#define Z1	GFX.Z1
-	#define Z2	GFX.Z2
+	#define Z1	BG.Z1
+	#define Z2	BG.Z2
 
 	template<class PIXEL>
 	struct DrawClippedTile16
 	{
-		typedef void (*call_t)(uint32, uint32, uint32, uint32, uint32, uint32);
+		typedef void (*call_t)(struct SBG &, uint32, uint32, uint32, uint32, uint32, uint32);
 
 		enum { Pitch = PIXEL::Pitch };
 		typedef typename PIXEL::bpstart_t bpstart_t;
 
-		static void Draw(uint32 Tile, uint32 Offset, uint32 StartPixel, uint32 Width, uint32 StartLine, uint32 LineCount)
+		static void Draw(struct SBG &BG, uint32 Tile, uint32 Offset, uint32 StartPixel, uint32 Width, uint32 StartLine, uint32 LineCount)
 		{
-			CachedTile cache(Tile);
+			CachedTile cache(BG, Tile);
 			int32	l;
 			uint8	*bp, Pix, w;
 
@@ -328,7 +400,7 @@ namespace TileImpl {
 
 			if (!(Tile & (V_FLIP | H_FLIP)))
 			{
-				bp = cache.Ptr() + bpstart_t::Get(StartLine);
+				bp = cache.Ptr() + bpstart_t::Get(BG, StartLine);
 				OFFSET_IN_LINE;
 				for (l = LineCount; l > 0; l--, bp += 8 * Pitch, Offset += GFX.PPL)
 				{
@@ -349,7 +421,7 @@ namespace TileImpl {
 			else
 			if (!(Tile & V_FLIP))
 			{
-				bp = cache.Ptr() + bpstart_t::Get(StartLine);
+				bp = cache.Ptr() + bpstart_t::Get(BG, StartLine);
 				OFFSET_IN_LINE;
 				for (l = LineCount; l > 0; l--, bp += 8 * Pitch, Offset += GFX.PPL)
 				{
@@ -370,7 +442,7 @@ namespace TileImpl {
 			else
 			if (!(Tile & H_FLIP))
 			{
-				bp = cache.Ptr() + 56 - bpstart_t::Get(StartLine);
+				bp = cache.Ptr() + 56 - bpstart_t::Get(BG, StartLine);
 				OFFSET_IN_LINE;
 				for (l = LineCount; l > 0; l--, bp -= 8 * Pitch, Offset += GFX.PPL)
 				{
@@ -390,7 +462,7 @@ namespace TileImpl {
 			}
 			else
 			{
-				bp = cache.Ptr() + 56 - bpstart_t::Get(StartLine);
+				bp = cache.Ptr() + 56 - bpstart_t::Get(BG, StartLine);
 				OFFSET_IN_LINE;
 				for (l = LineCount; l > 0; l--, bp -= 8 * Pitch, Offset += GFX.PPL)
 				{
@@ -417,19 +489,19 @@ namespace TileImpl {
 	// Basic routine to render a single mosaic pixel.
 	// DRAW_PIXEL, bpstart_t, Z1, Z2 and Pix are the same as above, but Pitch is not used.
 
-	#define Z1	GFX.Z1
-	#define Z2	GFX.Z2
+	#define Z1	BG.Z1
+	#define Z2	BG.Z2
 
 	template<class PIXEL>
 	struct DrawMosaicPixel16
 	{
-		typedef void (*call_t)(uint32, uint32, uint32, uint32, uint32, uint32);
+		typedef void (*call_t)(struct SBG &, uint32, uint32, uint32, uint32, uint32, uint32);
 
 		typedef typename PIXEL::bpstart_t bpstart_t;
 
-		static void Draw(uint32 Tile, uint32 Offset, uint32 StartLine, uint32 StartPixel, uint32 Width, uint32 LineCount)
+		static void Draw(struct SBG &BG, uint32 Tile, uint32 Offset, uint32 StartLine, uint32 StartPixel, uint32 Width, uint32 LineCount)
 		{
-			CachedTile cache(Tile);
+			CachedTile cache(BG, Tile);
 			int32	l, w;
 			uint8	Pix;
 
@@ -442,9 +514,9 @@ namespace TileImpl {
 				StartPixel = 7 - StartPixel;
 
 			if (Tile & V_FLIP)
-				Pix = cache.Ptr()[56 - bpstart_t::Get(StartLine) + StartPixel];
+				Pix = cache.Ptr()[56 - bpstart_t::Get(BG, StartLine) + StartPixel];
 			else
-				Pix = cache.Ptr()[bpstart_t::Get(StartLine) + StartPixel];
+				Pix = cache.Ptr()[bpstart_t::Get(BG, StartLine) + StartPixel];
 
 			if (Pix)
 			{
@@ -473,17 +545,17 @@ namespace TileImpl {
 	template<class PIXEL>
 	struct DrawBackdrop16
 	{
-		typedef void (*call_t)(uint32 Offset, uint32 Left, uint32 Right);
+		typedef void (*call_t)(struct SBG &, uint32 Offset, uint32 Left, uint32 Right);
 
-		static void Draw(uint32 Offset, uint32 Left, uint32 Right)
+		static void Draw(struct SBG &BG, uint32 Offset, uint32 Left, uint32 Right)
 		{
 			uint32	l, x;
 
-			GFX.RealScreenColors = IPPU.ScreenColors;
-			GFX.ScreenColors = GFX.ClipColors ? BlackColourMap : GFX.RealScreenColors;
+			BG.RealScreenColors = IPPU.ScreenColors;
+			BG.ScreenColors = BG.ClipColors ? BlackColourMap : BG.RealScreenColors;
 
 			OFFSET_IN_LINE;
-			for (l = GFX.StartY; l <= GFX.EndY; l++, Offset += GFX.PPL)
+			for (l = BG.StartY; l <= BG.EndY; l++, Offset += GFX.PPL)
 			{
 				for (x = Left; x < Right; x++)
 					DRAW_PIXEL(x, 1);
@@ -496,6 +568,343 @@ namespace TileImpl {
 	#undef Z2
 	#undef DRAW_PIXEL
 
+	// Routine to render one clip window of a background layer without mosaic
+	// or offset-per-tile, from BG.StartY to BG.EndY.
+	// The tiles go to DrawTile16 and DrawClippedTile16 of the same PIXEL,
+	// which the compiler can inline, so the layer takes one call per window
+	// instead of one per tile through BG.DrawTile*.
+
+	template<class PIXEL>
+	struct DrawBackground16
+	{
+		typedef void (*call_t)(struct SBG &, uint32, uint8, uint8, uint32);
+
+		typedef DrawTile16<PIXEL> DrawTile;
+		typedef DrawClippedTile16<PIXEL> DrawClippedTile;
+
+		static void Draw(struct SBG &BG, uint32 bg, uint8 Zh, uint8 Zl, uint32 clip)
+		{
+			uint32	Tile;
+			uint16	*SC0, *SC1, *SC2, *SC3;
+
+			SC0 = (uint16 *) &Memory.VRAM[PPU.BG[bg].SCBase << 1];
+			SC1 = (PPU.BG[bg].SCSize & 1) ? SC0 + 1024 : SC0;
+			if (SC1 >= (uint16 *) (Memory.VRAM + 0x10000))
+				SC1 -= 0x8000;
+			SC2 = (PPU.BG[bg].SCSize & 2) ? SC1 + 1024 : SC0;
+			if (SC2 >= (uint16 *) (Memory.VRAM + 0x10000))
+				SC2 -= 0x8000;
+			SC3 = (PPU.BG[bg].SCSize & 1) ? SC2 + 1024 : SC2;
+			if (SC3 >= (uint16 *) (Memory.VRAM + 0x10000))
+				SC3 -= 0x8000;
+
+			uint32	Lines;
+			int		OffsetMask  = (BG.TileSizeH == 16) ? 0x3ff : 0x1ff;
+			int		OffsetShift = (BG.TileSizeV == 16) ? 4 : 3;
+			int		PixWidth = IPPU.DoubleWidthPixels ? 2 : 1;
+			bool8	HiresInterlace = IPPU.Interlace && IPPU.DoubleWidthPixels;
+
+			for (uint32 Y = BG.StartY; Y <= BG.EndY; Y += Lines)
+			{
+				uint32	Y2 = HiresInterlace ? Y * 2 + GFX.InterlaceFrame : Y;
+				uint32	VOffset = LineData[Y].BG[bg].VOffset + (HiresInterlace ? 1 : 0);
+				uint32	HOffset = LineData[Y].BG[bg].HOffset;
+				int		VirtAlign = ((Y2 + VOffset) & 7) >> (HiresInterlace ? 1 : 0);
+
+				for (Lines = 1; Lines < BG.LinesPerTile - VirtAlign; Lines++)
+				{
+					if ((VOffset != LineData[Y + Lines].BG[bg].VOffset) || (HOffset != LineData[Y + Lines].BG[bg].HOffset))
+						break;
+				}
+
+				if (Y + Lines > BG.EndY)
+					Lines = BG.EndY - Y + 1;
+
+				VirtAlign <<= 3;
+
+				uint32	t1, t2;
+				uint32	TilemapRow = (VOffset + Y2) >> OffsetShift;
+				BG.InterlaceLine = ((VOffset + Y2) & 1) << 3;
+
+				if ((VOffset + Y2) & 8)
+				{
+					t1 = 16;
+					t2 = 0;
+				}
+				else
+				{
+					t1 = 0;
+					t2 = 16;
+				}
+
+				uint16	*b1, *b2;
+
+				if (TilemapRow & 0x20)
+				{
+					b1 = SC2;
+					b2 = SC3;
+				}
+				else
+				{
+					b1 = SC0;
+					b2 = SC1;
+				}
+
+				b1 += (TilemapRow & 0x1f) << 5;
+				b2 += (TilemapRow & 0x1f) << 5;
+
+				uint32	Left   = BG.Clip[bg].Left[clip];
+				uint32	Right  = BG.Clip[bg].Right[clip];
+				uint32	Offset = Left * PixWidth + Y * GFX.PPL;
+				uint32	HPos   = (HOffset + Left) & OffsetMask;
+				uint32	HTile  = HPos >> 3;
+				uint16	*t;
+
+				if (BG.TileSizeH == 8)
+				{
+					if (HTile > 31)
+						t = b2 + (HTile & 0x1f);
+					else
+						t = b1 + HTile;
+				}
+				else
+				{
+					if (HTile > 63)
+						t = b2 + ((HTile >> 1) & 0x1f);
+					else
+						t = b1 + (HTile >> 1);
+				}
+
+				uint32	Width = Right - Left;
+
+				if (HPos & 7)
+				{
+					uint32	l = HPos & 7;
+					uint32	w = 8 - l;
+					if (w > Width)
+						w = Width;
+
+					Offset -= l * PixWidth;
+					Tile = READ_WORD(t);
+					BG.Z1 = BG.Z2 = (Tile & 0x2000) ? Zh : Zl;
+
+					if (BG.TileSizeV == 16)
+						Tile = TILE_PLUS(Tile, ((Tile & V_FLIP) ? t2 : t1));
+
+					if (BG.TileSizeH == 8)
+					{
+						DrawClippedTile::Draw(BG, Tile, Offset, l, w, VirtAlign, Lines);
+						t++;
+						if (HTile == 31)
+							t = b2;
+						else
+						if (HTile == 63)
+							t = b1;
+					}
+					else
+					{
+						if (!(Tile & H_FLIP))
+							DrawClippedTile::Draw(BG, TILE_PLUS(Tile, (HTile & 1)), Offset, l, w, VirtAlign, Lines);
+						else
+							DrawClippedTile::Draw(BG, TILE_PLUS(Tile, 1 - (HTile & 1)), Offset, l, w, VirtAlign, Lines);
+						t += HTile & 1;
+						if (HTile == 63)
+							t = b2;
+						else
+						if (HTile == 127)
+							t = b1;
+					}
+
+					HTile++;
+					Offset += 8 * PixWidth;
+					Width -= w;
+				}
+
+				while (Width >= 8)
+				{
+					Tile = READ_WORD(t);
+					BG.Z1 = BG.Z2 = (Tile & 0x2000) ? Zh : Zl;
+
+					if (BG.TileSizeV == 16)
+						Tile = TILE_PLUS(Tile, ((Tile & V_FLIP) ? t2 : t1));
+
+					if (BG.TileSizeH == 8)
+					{
+						DrawTile::Draw(BG, Tile, Offset, VirtAlign, Lines);
+						t++;
+						if (HTile == 31)
+							t = b2;
+						else
+						if (HTile == 63)
+							t = b1;
+					}
+					else
+					{
+						if (!(Tile & H_FLIP))
+							DrawTile::Draw(BG, TILE_PLUS(Tile, (HTile & 1)), Offset, VirtAlign, Lines);
+						else
+							DrawTile::Draw(BG, TILE_PLUS(Tile, 1 - (HTile & 1)), Offset, VirtAlign, Lines);
+						t += HTile & 1;
+						if (HTile == 63)
+							t = b2;
+						else
+						if (HTile == 127)
+							t = b1;
+					}
+
+					HTile++;
+					Offset += 8 * PixWidth;
+					Width -= 8;
+				}
+
+				if (Width)
+				{
+					Tile = READ_WORD(t);
+					BG.Z1 = BG.Z2 = (Tile & 0x2000) ? Zh : Zl;
+
+					if (BG.TileSizeV == 16)
+						Tile = TILE_PLUS(Tile, ((Tile & V_FLIP) ? t2 : t1));
+
+					if (BG.TileSizeH == 8)
+						DrawClippedTile::Draw(BG, Tile, Offset, 0, Width, VirtAlign, Lines);
+					else
+					{
+						if (!(Tile & H_FLIP))
+							DrawClippedTile::Draw(BG, TILE_PLUS(Tile, (HTile & 1)), Offset, 0, Width, VirtAlign, Lines);
+						else
+							DrawClippedTile::Draw(BG, TILE_PLUS(Tile, 1 - (HTile & 1)), Offset, 0, Width, VirtAlign, Lines);
+					}
+				}
+			}
+		}
+	};
+
+	// Draws 8 pixels of a row of BGLineCache, all from one tile, at depth Z.
+	template<class PIXEL>
+	struct DrawBGLineRunScalar
+	{
+		static alwaysinline void Draw(struct SBG &BG, uint32 x, uint32 Offset, uint32 OffsetInLine, uint8 *bp, uint8 Z)
+		{
+			uint8	Pix;
+
+			for (int i = 0; i < 8; i++)
+			{
+				Pix = bp[i]; PIXEL::Draw(BG, x + i, Pix, Offset, OffsetInLine, Pix, Z, Z);
+			}
+		}
+	};
+
+#ifdef TILE_SSE2
+	// Normal width pixels stored without math take one depth test and one
+	// select for all 8.
+	template<bool Plain, class MATH>
+	struct DrawBGLineRunSSE2 : public DrawBGLineRunScalar< Normal1x1<MATH> > {};
+
+	template<class MATH>
+	struct DrawBGLineRunSSE2<true, MATH>
+	{
+		static alwaysinline void Draw(struct SBG &BG, uint32 x, uint32 Offset, uint32 OffsetInLine, uint8 *bp, uint8 Z)
+		{
+			Offset += x;
+
+			// depths are unsigned, flip the sign bits for the signed compare
+			__m128i	sign  = _mm_set1_epi8((char) 0x80);
+			__m128i	z     = _mm_set1_epi8(Z);
+			__m128i	pix   = _mm_loadl_epi64((__m128i *) bp);
+			__m128i	depth = _mm_loadl_epi64((__m128i *) (BG.DB + Offset));
+			__m128i	draw  = _mm_andnot_si128(_mm_cmpeq_epi8(pix, _mm_setzero_si128()),
+											 _mm_cmpgt_epi8(_mm_xor_si128(z, sign), _mm_xor_si128(depth, sign)));
+
+			if (!(_mm_movemask_epi8(draw) & 0xff))
+				return;
+
+			_mm_storel_epi64((__m128i *) (BG.DB + Offset), _mm_or_si128(_mm_and_si128(draw, z), _mm_andnot_si128(draw, depth)));
+
+			__m128i	colors = _mm_set_epi16(BG.ScreenColors[bp[7]], BG.ScreenColors[bp[6]], BG.ScreenColors[bp[5]], BG.ScreenColors[bp[4]],
+										   BG.ScreenColors[bp[3]], BG.ScreenColors[bp[2]], BG.ScreenColors[bp[1]], BG.ScreenColors[bp[0]]);
+			__m128i	draw16 = _mm_unpacklo_epi8(draw, draw);
+			__m128i	screen = _mm_loadu_si128((__m128i *) (BG.S + Offset));
+			_mm_storeu_si128((__m128i *) (BG.S + Offset), _mm_or_si128(_mm_and_si128(draw16, colors), _mm_andnot_si128(draw16, screen)));
+
+			if (MATH::Marks)
+			{
+				__m128i	math = _mm_loadl_epi64((__m128i *) (GFX.MathBuffer + Offset));
+				__m128i	mark = _mm_set1_epi8(MATH::MarkValue(BG));
+				_mm_storel_epi64((__m128i *) (GFX.MathBuffer + Offset), _mm_or_si128(_mm_and_si128(draw, mark), _mm_andnot_si128(draw, math)));
+			}
+		}
+	};
+
+	template<class PIXEL>
+	struct DrawBGLineRun : public DrawBGLineRunScalar<PIXEL> {};
+
+	template<class MATH>
+	struct DrawBGLineRun< Normal1x1<MATH> > : public DrawBGLineRunSSE2<MATH::Plain, MATH> {};
+#else
+	template<class PIXEL>
+	struct DrawBGLineRun : public DrawBGLineRunScalar<PIXEL> {};
+#endif
+
+	// Routine to render one clip window of a background layer from
+	// BGLineCache[bg], from BG.StartY to BG.EndY. S9xBuildBGLines() has drawn
+	// every row these lines show, so only the depth test and math are left.
+	template<class PIXEL>
+	struct DrawBGLines16
+	{
+		typedef void (*call_t)(struct SBG &, uint32, uint8, uint8, uint32);
+
+		static void Draw(struct SBG &BG, uint32 bg, uint8 Zh, uint8 Zl, uint32 clip)
+		{
+			struct SBGLineCache	*c = &BGLineCache[bg];
+
+			BG.RealScreenColors = IPPU.ScreenColors;
+			BG.ScreenColors = BG.ClipColors ? BlackColourMap : BG.RealScreenColors;
+
+			uint32	Left  = BG.Clip[bg].Left[clip];
+			uint32	Right = BG.Clip[bg].Right[clip];
+			uint32	WidthMask  = c->Width - 1;
+			uint32	HeightMask = c->Height - 1;
+
+			uint32	Offset = BG.StartY * GFX.PPL;
+			OFFSET_IN_LINE;
+			for (uint32 Y = BG.StartY; Y <= BG.EndY; Y++, Offset += GFX.PPL)
+			{
+				uint32	VPos = (LineData[Y].BG[bg].VOffset + Y) & HeightMask;
+				uint8	*row = c->Pixels + VPos * c->Width;
+				uint32	HPos = LineData[Y].BG[bg].HOffset + Left;
+
+				// Eight pixels at a time, as they came from one tile
+				for (uint32 x = Left; x < Right; )
+				{
+					uint32	p = HPos & WidthMask;
+					uint32	n = 8 - (p & 7);
+					if (n > Right - x)
+						n = Right - x;
+
+					if (c->Opaque[VPos][p >> 8] & (1 << ((p >> 3) & 31)))
+					{
+						uint8	*bp = row + p;
+						uint8	Z = (c->High[VPos][p >> 8] & (1 << ((p >> 3) & 31))) ? Zh : Zl;
+						uint8	Pix;
+
+						if (n == 8)
+							DrawBGLineRun<PIXEL>::Draw(BG, x, Offset, OffsetInLine, bp, Z);
+						else
+						{
+							for (uint32 i = 0; i < n; i++)
+							{
+								Pix = bp[i]; PIXEL::Draw(BG, x + i, Pix, Offset, OffsetInLine, Pix, Z, Z);
+							}
+						}
+					}
+
+					x += n;
+					HPos += n;
+				}
+			}
+		}
+	};
+
 	// Basic routine to render a chunk of a Mode 7 BG.
 	// Mode 7 has no interlace, so bpstart_t and Pitch are unused.
 	// We get some new parameters, so we can use the same DRAW_TILE to do BG1 or BG2:
@@ -506,7 +915,7 @@ namespace TileImpl {
 
 	#define CLIP_10_BIT_SIGNED(a)	(((a) & 0x2000) ? ((a) | ~0x3ff) : ((a) & 0x3ff))
 
-	#define DRAW_PIXEL(N, M) PIXEL::Draw(N, M, Offset, OffsetInLine, Pix, OP::Z1(D, b), OP::Z2(D, b))
+	#define DRAW_PIXEL(N, M) PIXEL::Draw(BG, N, M, Offset, OffsetInLine, Pix, OP::Z1(D, b), OP::Z2(D, b))
 
 	struct DrawMode7BG1_OP
 	{
@@ -532,29 +941,27 @@ namespace TileImpl {
 	template<class PIXEL, class OP>
 	struct DrawTileNormal
 	{
-		typedef void (*call_t)(uint32 Left, uint32 Right, int D);
+		typedef void (*call_t)(struct SBG &, uint32 Left, uint32 Right, int D);
 
-		static void Draw(uint32 Left, uint32 Right, int D)
+		static void Draw(struct SBG &BG, uint32 Left, uint32 Right, int D)
 		{
-			uint8	*VRAM1 = Memory.VRAM + 1;
-
 			if (OP::DCMODE())
 			{
-				GFX.RealScreenColors = DirectColourMaps[0];
+				BG.RealScreenColors = DirectColourMaps[0];
 			}
 			else
-				GFX.RealScreenColors = IPPU.ScreenColors;
+				BG.RealScreenColors = IPPU.ScreenColors;
 
-			GFX.ScreenColors = GFX.ClipColors ? BlackColourMap : GFX.RealScreenColors;
+			BG.ScreenColors = BG.ClipColors ? BlackColourMap : BG.RealScreenColors;
 
 			int	aa, cc;
 			int	startx;
 
-			uint32	Offset = GFX.StartY * GFX.PPL;
-			struct SLineMatrixData	*l = &LineMatrixData[GFX.StartY];
+			uint32	Offset = BG.StartY * GFX.PPL;
+			struct SLineMatrixData	*l = &LineMatrixData[BG.StartY];
 
 			OFFSET_IN_LINE;
-			for (uint32 Line = GFX.StartY; Line <= GFX.EndY; Line++, Offset += GFX.PPL, l++)
+			for (uint32 Line = BG.StartY; Line <= BG.EndY; Line++, Offset += GFX.PPL, l++)
 			{
 				int	yy, starty;
 
@@ -592,42 +999,15 @@ namespace TileImpl {
 				int	CC = l->MatrixC * startx + ((l->MatrixC * xx) & ~63);
 
 				uint8	Pix;
+				uint8	Pixels[SNES_WIDTH];
 
-				if (!PPU.Mode7Repeat)
-				{
-					for (uint32 x = Left; x < Right; x++, AA += aa, CC += cc)
-					{
-						int	X = ((AA + BB) >> 8) & 0x3ff;
-						int	Y = ((CC + DD) >> 8) & 0x3ff;
-
-						uint8	*TileData = VRAM1 + (Memory.VRAM[((Y & ~7) << 5) + ((X >> 2) & ~1)] << 7);
-						uint8	b = *(TileData + ((Y & 7) << 4) + ((X & 7) << 1));
+				S9xFetchMode7Pixels(Pixels, Right - Left, AA + BB, CC + DD, aa, cc);
 
-						Pix = b & OP::MASK; DRAW_PIXEL(x, Pix);
-					}
-				}
-				else
+				for (uint32 x = Left; x < Right; x++)
 				{
-					for (uint32 x = Left; x < Right; x++, AA += aa, CC += cc)
-					{
-						int	X = ((AA + BB) >> 8);
-						int	Y = ((CC + DD) >> 8);
-
-						uint8	b;
-
-						if (((X | Y) & ~0x3ff) == 0)
-						{
-							uint8	*TileData = VRAM1 + (Memory.VRAM[((Y & ~7) << 5) + ((X >> 2) & ~1)] << 7);
-							b = *(TileData + ((Y & 7) << 4) + ((X & 7) << 1));
-						}
-						else
-						if (PPU.Mode7Repeat == 3)
-							b = *(VRAM1    + ((Y & 7) << 4) + ((X & 7) << 1));
-						else
-							continue;
+					uint8	b = Pixels[x - Left];
 
-						Pix = b & OP::MASK; DRAW_PIXEL(x, Pix);
-					}
+					Pix = b & OP::MASK; DRAW_PIXEL(x, Pix);
 				}
 			}
 		}
@@ -641,23 +1021,21 @@ namespace TileImpl {
 	template<class PIXEL, class OP>
 	struct DrawTileMosaic
 	{
-		typedef void (*call_t)(uint32 Left, uint32 Right, int D);
+		typedef void (*call_t)(struct SBG &, uint32 Left, uint32 Right, int D);
 
-		static void Draw(uint32 Left, uint32 Right, int D)
+		static void Draw(struct SBG &BG, uint32 Left, uint32 Right, int D)
 		{
-			uint8	*VRAM1 = Memory.VRAM + 1;
-
 			if (OP::DCMODE())
 			{
-				GFX.RealScreenColors = DirectColourMaps[0];
+				BG.RealScreenColors = DirectColourMaps[0];
 			}
 			else
-				GFX.RealScreenColors = IPPU.ScreenColors;
+				BG.RealScreenColors = IPPU.ScreenColors;
 
-			GFX.ScreenColors = GFX.ClipColors ? BlackColourMap : GFX.RealScreenColors;
+			BG.ScreenColors = BG.ClipColors ? BlackColourMap : BG.RealScreenColors;
 
 			int	aa, cc;
-			int	startx, StartY = GFX.StartY;
+			int	startx, StartY = BG.StartY;
 
 			int		HMosaic = 1, VMosaic = 1, MosaicStart = 0;
 			int32	MLeft = Left, MRight = Right;
@@ -665,7 +1043,7 @@ namespace TileImpl {
 			if (PPU.BGMosaic[0])
 			{
 				VMosaic = PPU.Mosaic;
-				MosaicStart = ((uint32) GFX.StartY - PPU.MosaicStart) % VMosaic;
+				MosaicStart = ((uint32) BG.StartY - PPU.MosaicStart) % VMosaic;
 				StartY -= MosaicStart;
 			}
 
@@ -681,10 +1059,10 @@ namespace TileImpl {
 			struct SLineMatrixData	*l = &LineMatrixData[StartY];
 
 			OFFSET_IN_LINE;
-			for (uint32 Line = StartY; Line <= GFX.EndY; Line += VMosaic, Offset += VMosaic * GFX.PPL, l += VMosaic)
+			for (uint32 Line = StartY; Line <= BG.EndY; Line += VMosaic, Offset += VMosaic * GFX.PPL, l += VMosaic)
 			{
-				if (Line + VMosaic > GFX.EndY)
-					VMosaic = GFX.EndY - Line + 1;
+				if (Line + VMosaic > BG.EndY)
+					VMosaic = BG.EndY - Line + 1;
 
 				int	yy, starty;
 
@@ -722,63 +1100,25 @@ namespace TileImpl {
 				int	CC = l->MatrixC * startx + ((l->MatrixC * xx) & ~63);
 
 				uint8	Pix;
-				uint8	ctr = 1;
-
-				if (!PPU.Mode7Repeat)
-				{
-					for (int32 x = MLeft; x < MRight; x++, AA += aa, CC += cc)
-					{
-						if (--ctr)
-							continue;
-						ctr = HMosaic;
+				uint8	Pixels[SNES_WIDTH];
 
-						int	X = ((AA + BB) >> 8) & 0x3ff;
-						int	Y = ((CC + DD) >> 8) & 0x3ff;
+				// One pixel is fetched for every HMosaic ones drawn
+				S9xFetchMode7Pixels(Pixels, (MRight - MLeft) / HMosaic, AA + BB, CC + DD, aa * HMosaic, cc * HMosaic);
 
-						uint8	*TileData = VRAM1 + (Memory.VRAM[((Y & ~7) << 5) + ((X >> 2) & ~1)] << 7);
-						uint8	b = *(TileData + ((Y & 7) << 4) + ((X & 7) << 1));
-
-						if ((Pix = (b & OP::MASK)))
-						{
-							for (int32 h = MosaicStart; h < VMosaic; h++)
-							{
-								for (int32 w = x + HMosaic - 1; w >= x; w--)
-									DRAW_PIXEL(w + h * GFX.PPL, (w >= (int32) Left && w < (int32) Right));
-							}
-						}
-					}
-				}
-				else
+				for (int32 x = MLeft, i = 0; x < MRight; x += HMosaic, i++)
 				{
-					for (int32 x = MLeft; x < MRight; x++, AA += aa, CC += cc)
-					{
-						if (--ctr)
-							continue;
-						ctr = HMosaic;
+					uint8	b = Pixels[i];
 
-						int	X = ((AA + BB) >> 8);
-						int	Y = ((CC + DD) >> 8);
-
-						uint8	b;
-
-						if (((X | Y) & ~0x3ff) == 0)
+					if ((Pix = (b & OP::MASK)))
+					{
+						// Lines are stepped in the offset rather than in N,
+						// which the double width plotters scale by two
+						for (int32 h = MosaicStart; h < VMosaic; h++)
 						{
-							uint8	*TileData = VRAM1 + (Memory.VRAM[((Y & ~7) << 5) + ((X >> 2) & ~1)] << 7);
-							b = *(TileData + ((Y & 7) << 4) + ((X & 7) << 1));
-						}
-						else
-						if (PPU.Mode7Repeat == 3)
-							b = *(VRAM1    + ((Y & 7) << 4) + ((X & 7) << 1));
-						else
-							continue;
+							uint32	LineOffset = Offset + h * GFX.PPL;
 
-						if ((Pix = (b & OP::MASK)))
-						{
-							for (int32 h = MosaicStart; h < VMosaic; h++)
-							{
-								for (int32 w = x + HMosaic - 1; w >= x; w--)
-									DRAW_PIXEL(w + h * GFX.PPL, (w >= (int32) Left && w < (int32) Right));
-							}
+							for (int32 w = x + HMosaic - 1; w >= x; w--)
+								PIXEL::Draw(BG, w, (w >= (int32) Left && w < (int32) Right), LineOffset, OffsetInLine, Pix, OP::Z1(D, b), OP::Z2(D, b));
 						}
 					}
 				}
@@ -0,0 +1,515 @@
+/*****************************************************************************\
+     Snes9x - Portable Super Nintendo Entertainment System (TM) emulator.
+                This file is licensed under the Snes9x License.
+   For further information, consult the LICENSE file in the root directory.
+\*****************************************************************************/
+
+// Renders .spc snapshots to WAV using only the SMP and S-DSP cores, without
+// the 65c816, PPU or a loaded game. Files are processed in parallel by forked
+// workers, since SNES::smp and SNES::dsp are single global instances.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <math.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "snes9x.h"
+#include "apu.h"
+#include "bapu/snes/snes.hpp"
+
+static const int SPC_SAMPLE_RATE       = 32000;
+static const int SPC_CLOCKS_PER_SAMPLE = 32;
+static const int RENDER_BLOCK          = 1024;
+static const int DEFAULT_LENGTH        = 180;
+static const int DEFAULT_FADE          = 10000;
+
+// What the bapu core links against when it runs outside of snes9x
+struct SSettings	Settings;
+
+namespace SNES {
+CPU cpu;
+} // namespace SNES
+
+void S9xMSU1Generate (size_t)
+{
+}
+
+struct SPCJob
+{
+	std::string	in;
+	std::string	out;
+	int			length_ms;
+	int			fade_ms;
+};
+
+static struct
+{
+	const char	*outdir;
+	int			jobs;
+	int			length;
+	int			fade;
+	bool		quiet;
+} opts = { NULL, 0, -1, -1, false };
+
+static double GetTime (void)
+{
+	struct timeval	tv;
+
+	gettimeofday(&tv, NULL);
+	return (tv.tv_sec + tv.tv_usec / 1000000.0);
+}
+
+static void PutLE16 (uint8 *p, uint32 v)
+{
+	p[0] = v & 0xff;
+	p[1] = (v >> 8) & 0xff;
+}
+
+static void PutLE32 (uint8 *p, uint32 v)
+{
+	PutLE16(p, v);
+	PutLE16(p + 2, v >> 16);
+}
+
+static int ParseDigits (const uint8 *p, int len)
+{
+	int	v = 0, n = 0;
+
+	for (int i = 0; i < len && p[i]; i++)
+	{
+		if (p[i] < '0' || p[i] > '9')
+			return (-1);
+		v = v * 10 + p[i] - '0';
+		n++;
+	}
+
+	return (n ? v : -1);
+}
+
+// Play length and fade from the ID666 tag, in either its text or binary form
+static void ReadID666 (const uint8 *spc, int *length_ms, int *fade_ms)
+{
+	*length_ms = DEFAULT_LENGTH * 1000;
+	*fade_ms = DEFAULT_FADE;
+
+	if (spc[0x23] != 26)
+		return;
+
+	int	length = ParseDigits(spc + 0xa9, 3);
+	int	fade = ParseDigits(spc + 0xac, 5);
+
+	if (length < 0 && fade < 0)
+	{
+		length = spc[0xa9] | (spc[0xaa] << 8) | (spc[0xab] << 16);
+		fade = spc[0xac] | (spc[0xad] << 8) | (spc[0xae] << 16) | (spc[0xaf] << 24);
+	}
+
+	if (length > 0 && length <= 3600)
+		*length_ms = length * 1000;
+	if (fade >= 0 && fade <= 60000)
+		*fade_ms = fade;
+}
+
+static bool LoadFile (const char *filename, uint8 *buf)
+{
+	FILE	*fs = fopen(filename, "rb");
+	if (!fs)
+		return (false);
+
+	size_t	size = fread(buf, 1, SPC_FILE_SIZE, fs);
+	fclose(fs);
+
+	return (size >= SPC_FILE_SIZE - 64 && !memcmp(buf, "SNES-SPC700 Sound File Data", 27));
+}
+
+static bool Render (const SPCJob &job, const uint8 *spc)
+{
+	FILE	*fs = fopen(job.out.c_str(), "wb");
+	if (!fs)
+	{
+		fprintf(stderr, "%s: %s\n", job.out.c_str(), strerror(errno));
+		return (false);
+	}
+
+	uint32	frames = (uint32) ((int64) (job.length_ms + job.fade_ms) * SPC_SAMPLE_RATE / 1000);
+	uint32	fade_start = (uint32) ((int64) job.length_ms * SPC_SAMPLE_RATE / 1000);
+	uint32	data_size = frames * 4;
+
+	uint8	header[44];
+	memcpy(header, "RIFF", 4);
+	PutLE32(header + 4, 36 + data_size);
+	memcpy(header + 8, "WAVEfmt ", 8);
+	PutLE32(header + 16, 16);
+	PutLE16(header + 20, 1);
+	PutLE16(header + 22, 2);
+	PutLE32(header + 24, SPC_SAMPLE_RATE);
+	PutLE32(header + 28, SPC_SAMPLE_RATE * 4);
+	PutLE16(header + 32, 4);
+	PutLE16(header + 34, 16);
+	memcpy(header + 36, "data", 4);
+	PutLE32(header + 40, data_size);
+	fwrite(header, 1, sizeof(header), fs);
+
+	// Blocks can come out a sample pair longer or shorter than asked for, so
+	// leave the ring plenty of room
+	Resampler	resampler(RENDER_BLOCK * 8);
+	int16		samples[RENDER_BLOCK * 8];
+	uint8		bytes[RENDER_BLOCK * 8 * 2];
+
+	SNES::cpu.reset();
+	SNES::smp.power();
+	SNES::dsp.power();
+	SNES::dsp.spc_dsp.set_output(&resampler);
+	SNES::smp.load_spc(spc);
+	SNES::smp.clock = 0;
+
+	uint32	done = 0;
+
+	while (done < frames)
+	{
+		SNES::smp.clock -= RENDER_BLOCK * SPC_CLOCKS_PER_SAMPLE;
+		SNES::smp.enter();
+		SNES::dsp.synchronize();
+
+		int		count = resampler.space_filled();
+		resampler.pull(samples, count);
+
+		count >>= 1;
+		if ((uint32) count > frames - done)
+			count = frames - done;
+
+		for (int i = 0; i < count; i++, done++)
+		{
+			int	l = samples[i * 2];
+			int	r = samples[i * 2 + 1];
+
+			if (done >= fade_start)
+			{
+				int64	left = frames - done;
+				int64	fade = frames - fade_start;
+				l = (int) (l * left / fade);
+				r = (int) (r * left / fade);
+			}
+
+			PutLE16(bytes + i * 4, (uint16) l);
+			PutLE16(bytes + i * 4 + 2, (uint16) r);
+		}
+
+		fwrite(bytes, 4, count, fs);
+	}
+
+	bool	ok = !ferror(fs);
+	if (fclose(fs) != 0)
+		ok = false;
+
+	return (ok);
+}
+
+static bool IsSPC (const char *name)
+{
+	size_t	len = strlen(name);
+	return (len > 4 && !strcasecmp(name + len - 4, ".spc"));
+}
+
+static std::string OutputName (const std::string &in)
+{
+	std::string	base = in;
+	size_t		slash = base.rfind('/');
+
+	if (opts.outdir)
+		base = std::string(opts.outdir) + "/" + (slash == std::string::npos ? base : base.substr(slash + 1));
+
+	if (IsSPC(base.c_str()))
+		base.resize(base.size() - 4);
+
+	return (base + ".wav");
+}
+
+static void AddPath (const char *path, std::vector<SPCJob> &jobs)
+{
+	struct stat	st;
+	std::vector<std::string>	files;
+
+	if (stat(path, &st) == 0 && S_ISDIR(st.st_mode))
+	{
+		DIR	*dir = opendir(path);
+		if (!dir)
+		{
+			fprintf(stderr, "%s: %s\n", path, strerror(errno));
+			return;
+		}
+
+		struct dirent	*entry;
+		while ((entry = readdir(dir)))
+			if (IsSPC(entry->d_name))
+				files.push_back(std::string(path) + "/" + entry->d_name);
+
+		closedir(dir);
+		std::sort(files.begin(), files.end());
+	}
+	else
+		files.push_back(path);
+
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		SPCJob	job;
+		job.in = files[i];
+		job.out = OutputName(files[i]);
+		job.length_ms = job.fade_ms = 0;
+		jobs.push_back(job);
+	}
+}
+
+static void Usage (void)
+{
+	printf("Usage: spc2wav [options] <file.spc | directory> ...\n\n");
+	printf("-o <dir>      Write WAV files to <dir> instead of next to the input\n");
+	printf("-j <num>      Render <num> files at once (default: number of CPUs)\n");
+	printf("-l <sec>      Play length, overriding the ID666 tag (default %d)\n", DEFAULT_LENGTH);
+	printf("-f <ms>       Fade-out length, overriding the ID666 tag (default %d)\n", DEFAULT_FADE);
+	printf("-i <num>      Interpolation: 0 none, 1 linear, 2 gaussian, 3 cubic, 4 sinc\n");
+	printf("-q            Only report failures and the summary\n");
+	printf("-t            Check the batched S-DSP paths against the per-voice ones and exit\n");
+	printf("-b            Benchmark the resampler qualities and exit\n");
+	exit(1);
+}
+
+static int CheckDSP (void)
+{
+	int	errors = SNES::dsp.spc_dsp.check_interpolate_voices();
+
+	if (errors < 0)
+		printf("gaussian interpolation: not batched in this build\n");
+	else
+		printf("gaussian interpolation: %d mismatches\n", errors);
+
+	return (errors > 0 ? 1 : 0);
+}
+
+// THD+N in dB of len samples against the sine of freq cycles per sample that fits
+// them best; len must hold a whole number of cycles
+static double ThdN (const double *x, int len, double freq)
+{
+	double	c = 0.0, s = 0.0;
+
+	for (int i = 0; i < len; i++)
+	{
+		c += x[i] * cos(2.0 * M_PI * freq * i);
+		s += x[i] * sin(2.0 * M_PI * freq * i);
+	}
+
+	c *= 2.0 / len;
+	s *= 2.0 / len;
+
+	double	signal = 0.0, noise = 0.0;
+
+	for (int i = 0; i < len; i++)
+	{
+		double	fit = c * cos(2.0 * M_PI * freq * i) + s * sin(2.0 * M_PI * freq * i);
+		signal += fit * fit;
+		noise += (x[i] - fit) * (x[i] - fit);
+	}
+
+	return (10.0 * log10(noise / signal));
+}
+
+// Resamples half-scale sine tones from the S-DSP's rate to 48 kHz with each
+// Settings.ResamplerQuality, printing THD+N and how many stereo samples per
+// second each one produces
+static int BenchResampler (void)
+{
+	static const int	tones[] = { 1000, 5000, 10000, 14000 };
+	static const char	*names[] = { "hermite", "sinc 8", "sinc 16", "sinc 32" };
+	const int	tone_count = sizeof(tones) / sizeof(tones[0]);
+	const int	in_rate = 32040, out_rate = 48000;
+	const int	bench_blocks = in_rate * 300 / RENDER_BLOCK;
+
+	Resampler	resampler(RENDER_BLOCK * 8);
+	int16		in[RENDER_BLOCK * 2];
+	int16		out[RENDER_BLOCK * 8];
+	std::vector<double>	wave;
+
+	printf("%d -> %d Hz, THD+N in dB at", in_rate, out_rate);
+	for (int t = 0; t < tone_count; t++)
+		printf(" %d", tones[t]);
+	printf(" Hz, stereo samples/s\n");
+
+	for (int q = 0; q < 4; q++)
+	{
+		resampler.set_quality(q);
+		resampler.time_ratio((double) in_rate / out_rate);
+		printf("%-8s", names[q]);
+
+		for (int t = 0; t < tone_count; t++)
+		{
+			resampler.clear();
+			wave.clear();
+
+			// One block of output to let the filter settle, then a second of it
+			for (int n = 0; wave.size() < (size_t) (RENDER_BLOCK + out_rate);)
+			{
+				for (int i = 0; i < RENDER_BLOCK; i++, n++)
+					in[i * 2] = in[i * 2 + 1] = (int16) lrint(16384.0 * sin(2.0 * M_PI * tones[t] * n / in_rate));
+
+				resampler.push(in, RENDER_BLOCK * 2);
+
+				int	count = resampler.avail();
+				resampler.read(out, count);
+
+				for (int i = 0; i < count; i += 2)
+					wave.push_back(out[i]);
+			}
+
+			printf(" %5.0f", ThdN(&wave[RENDER_BLOCK], out_rate, (double) tones[t] / out_rate));
+		}
+
+		resampler.clear();
+
+		double	produced = 0.0;
+		double	start = GetTime();
+
+		for (int b = 0; b < bench_blocks; b++)
+		{
+			resampler.push(in, RENDER_BLOCK * 2);
+
+			int	count = resampler.avail();
+			resampler.read(out, count);
+			produced += count >> 1;
+		}
+
+		double	elapsed = GetTime() - start;
+		printf("  %4.0fM/s\n", elapsed > 0.0 ? produced / elapsed / 1000000.0 : 0.0);
+	}
+
+	return (0);
+}
+
+int main (int argc, char **argv)
+{
+	std::vector<SPCJob>	jobs;
+
+	memset(&Settings, 0, sizeof(Settings));
+	Settings.InterpolationMethod = 2;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-o") && i + 1 < argc)
+			opts.outdir = argv[++i];
+		else
+		if (!strcmp(argv[i], "-j") && i + 1 < argc)
+			opts.jobs = atoi(argv[++i]);
+		else
+		if (!strcmp(argv[i], "-l") && i + 1 < argc)
+			opts.length = atoi(argv[++i]);
+		else
+		if (!strcmp(argv[i], "-f") && i + 1 < argc)
+			opts.fade = atoi(argv[++i]);
+		else
+		if (!strcmp(argv[i], "-i") && i + 1 < argc)
+			Settings.InterpolationMethod = atoi(argv[++i]);
+		else
+		if (!strcmp(argv[i], "-q"))
+			opts.quiet = true;
+		else
+		if (!strcmp(argv[i], "-t"))
+			return (CheckDSP());
+		else
+		if (!strcmp(argv[i], "-b"))
+			return (BenchResampler());
+		else
+		if (argv[i][0] == '-')
+			Usage();
+		else
+			AddPath(argv[i], jobs);
+	}
+
+	if (jobs.empty())
+		Usage();
+
+	if (opts.jobs <= 0)
+		opts.jobs = (int) sysconf(_SC_NPROCESSORS_ONLN);
+	if (opts.jobs <= 0)
+		opts.jobs = 1;
+
+	static uint8	spc[SPC_FILE_SIZE];
+	double	start = GetTime();
+	double	audio = 0.0;
+	int		running = 0, failed = 0;
+	size_t	next = 0;
+
+	while (next < jobs.size() || running)
+	{
+		if (next < jobs.size() && running < opts.jobs)
+		{
+			SPCJob	&job = jobs[next++];
+
+			memset(spc, 0, sizeof(spc));
+			if (!LoadFile(job.in.c_str(), spc))
+			{
+				fprintf(stderr, "%s: not a valid SPC file\n", job.in.c_str());
+				failed++;
+				continue;
+			}
+
+			ReadID666(spc, &job.length_ms, &job.fade_ms);
+			if (opts.length >= 0)
+				job.length_ms = opts.length * 1000;
+			if (opts.fade >= 0)
+				job.fade_ms = opts.fade;
+
+			fflush(stdout);
+			pid_t	pid = fork();
+			if (pid == 0)
+			{
+				double	t = GetTime();
+				bool	ok = Render(job, spc);
+
+				if (ok && !opts.quiet)
+				{
+					t = GetTime() - t;
+					double	len = (job.length_ms + job.fade_ms) / 1000.0;
+					printf("%s: %.1fs in %.2fs (%.0fx)\n", job.out.c_str(), len, t, t > 0.0 ? len / t : 0.0);
+				}
+
+				fflush(stdout);
+				_exit(ok ? 0 : 1);
+			}
+
+			if (pid < 0)
+			{
+				fprintf(stderr, "%s: %s\n", job.in.c_str(), strerror(errno));
+				failed++;
+				continue;
+			}
+
+			audio += (job.length_ms + job.fade_ms) / 1000.0;
+			running++;
+			continue;
+		}
+
+		int		status;
+		if (wait(&status) < 0)
+			break;
+
+		running--;
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			failed++;
+	}
+
+	double	elapsed = GetTime() - start;
+	printf("%d files, %d failed, %.0fs of audio in %.2fs (%.0fx realtime, %d jobs)\n",
+		   (int) jobs.size(), failed, audio, elapsed, elapsed > 0.0 ? audio / elapsed : 0.0, opts.jobs);
+
+	return (failed ? 1 : 0);
+}
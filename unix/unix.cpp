@@ -19,7 +19,9 @@
 #ifdef USE_THREADS
 #include <sched.h>
 #include <pthread.h>
-#include <vector>
+#include <semaphore.h>
+#include <poll.h>
+#include <atomic>
 #endif
 #include <sys/stat.h>
 #include <sys/time.h>
@@ -110,6 +112,7 @@ struct SUnixSettings
 	uint32	SoundFragmentSize;
 	uint32	rewindBufferSize;
 	uint32	rewindGranularity;
+	uint32	FrameSkipLatency;
 };
 
 struct SoundStatus
@@ -166,6 +169,15 @@ static long log2 (long num)
 namespace {
 
 #if ! defined(NOSOUND)
+#if defined(USE_THREADS)
+	typedef std::atomic<uint32> SharedCounter;
+#else
+	typedef uint32 SharedCounter;
+#endif
+
+	// Sound is mixed straight into a preallocated single-producer/single-consumer
+	// ring by the emulation thread and drained to the device either by the sound
+	// thread or, without -threadsound, right after mixing. Neither side locks.
 	class S9xAudioOutput
 	{
 	public:
@@ -173,20 +185,25 @@ namespace {
 		{
 			m_FD = fd;
 			uint32 bufferSizeMS = unixSettings.SoundBufferSize; // milliseconds
-			// 4 = sizeof(uint16) * STEREO
-			m_BufferSize = int(uint64(sampleRateHz) * bufferSizeMS / 1000 * 4);
+			// 2 = STEREO, in 16-bit samples
+			m_RingSize = std::max(int(uint64(sampleRateHz) * bufferSizeMS / 1000 * 2), 1024);
+			m_Ring = new int16[m_RingSize];
+			m_Head = 0;
+			m_Tail = 0;
+			m_Underruns = 0;
+			m_Overruns = 0;
+			m_Started = false;
 
 #if defined(USE_THREADS)
-			m_WrittenSize = 0;
 			m_Thread = pthread_t();
 			m_isExit = false;
 			if (isThreaded)
 			{
-				m_BufferMutex = PTHREAD_MUTEX_INITIALIZER;
-				m_hasBuffer = PTHREAD_COND_INITIALIZER;
+				sem_init(&m_hasData, 0, 0);
 				if (pthread_create(&m_Thread, NULL, AudioOutputThreadEntry, this))
 				{
-					return;
+					m_Thread = pthread_t();
+					sem_destroy(&m_hasData);
 				}
 			}
 #endif
@@ -197,96 +214,125 @@ namespace {
 #if defined(USE_THREADS)
 			if (m_Thread)
 			{
-				pthread_mutex_lock(&m_BufferMutex);
-				{
-					m_isExit = true;
-					pthread_cond_signal(&m_hasBuffer);
-				}
-				pthread_mutex_unlock(&m_BufferMutex);
-
+				m_isExit = true;
+				sem_post(&m_hasData);
 				pthread_join(m_Thread, NULL);
-				pthread_mutex_destroy(&m_BufferMutex);
-				pthread_cond_destroy(&m_hasBuffer);
+				sem_destroy(&m_hasData);
 			}
 #endif
+			delete[] m_Ring;
 		}
 
-		void Write(void* data, int size)
+		// Mixes sampleCount samples into the ring. Whatever doesn't fit is
+		// dropped and counted as an overrun.
+		void Mix(int sampleCount)
 		{
+			uint32 head = m_Head;
+			int count = std::min(sampleCount, m_RingSize - int(head - m_Tail)) & ~1;
+			int pos = head % m_RingSize;
+			int first = std::min(count, m_RingSize - pos);
+
+			if (first > 0)
+				S9xMixSamples((uint8 *) (m_Ring + pos), first);
+			if (count > first)
+				S9xMixSamples((uint8 *) m_Ring, count - first);
+
+			if (count < sampleCount)
+			{
+				S9xClearSamples();
+				m_Overruns++;
+			}
+
+			m_Head = head + count;
+
 #if defined(USE_THREADS)
 			if (m_Thread)
 			{
-				pthread_mutex_lock(&m_BufferMutex);
-				{
-					if (int(m_Buffering.size()) < m_BufferSize)
-					{
-						size_t oldSize = m_Buffering.size();
-						size_t newSize = oldSize + size;
-						m_WrittenSize = newSize;
-						m_Buffering.resize(newSize);
-						memcpy(&m_Buffering[oldSize], data, size);
-						pthread_cond_signal(&m_hasBuffer);
-					}
-				}
-				pthread_mutex_unlock(&m_BufferMutex);
+				sem_post(&m_hasData);
+				return;
 			}
-			else
 #endif
-			{
-				WriteImpl(data, size);
-			}
+			Drain(false);
 		}
 
 		int GetFreeBufferSize()
 		{
+			// in bytes, like the device
+			int queued = int(m_Head - m_Tail) * 2;
+
 #if defined(USE_THREADS)
-			if (m_Thread)
-			{
-				int writtenSize;
-				pthread_mutex_lock(&m_BufferMutex);
-				{
-					writtenSize = m_WrittenSize;
-				}
-				pthread_mutex_unlock(&m_BufferMutex);
-				return m_BufferSize - writtenSize;
-			}
-			else
+			if (!m_Thread)
 #endif
 			{
 				audio_buf_info info;
 				ioctl(m_FD, SNDCTL_DSP_GETOSPACE, &info);
-				int writtenSize = info.fragsize * info.fragstotal - info.bytes;
-				return std::max(0, m_BufferSize - writtenSize);
+				queued += info.fragsize * info.fragstotal - info.bytes;
 			}
+
+			return std::max(0, m_RingSize * 2 - queued);
 		}
 
+		uint32 GetUnderruns() { return m_Underruns; }
+		uint32 GetOverruns()  { return m_Overruns; }
+
 	private:
-		void WriteImpl(const void* data, int size)
+		// Writes as much of the ring to the device as it takes. When blocking,
+		// waits for the device instead of giving up on a full buffer.
+		void Drain(bool blocking)
 		{
-			const char* p = reinterpret_cast<const char*>(data);
-			while (size > 0)
+			uint32 tail = m_Tail;
+			uint32 head = m_Head;
+
+#if !defined(USE_THREADS)
+			(void) blocking;
+#endif
+			if (tail == head)
+				return;
+
+			int delay = 0;
+			if (m_Started && ioctl(m_FD, SNDCTL_DSP_GETODELAY, &delay) == 0 && delay == 0)
+				m_Underruns++;
+			m_Started = true;
+
+			while (tail != head)
 			{
-				int result = write(m_FD, p, size);
+				int pos = tail % m_RingSize;
+				int count = std::min(int(head - tail), m_RingSize - pos);
+				int result = write(m_FD, m_Ring + pos, count * 2);
+
 				if (result < 0)
 				{
-					return;
+					if (errno == EINTR)
+						continue;
+#if defined(USE_THREADS)
+					if (blocking && errno == EAGAIN && !m_isExit)
+					{
+						struct pollfd p = { m_FD, POLLOUT, 0 };
+						poll(&p, 1, 100);
+						continue;
+					}
+#endif
+					break;
 				}
-				p += result;
-				size -= result;
+
+				tail += result / 2;
+				m_Tail = tail;
 			}
 		}
 
 		int m_FD;
-		int m_BufferSize;
+		int16 *m_Ring;
+		int m_RingSize; // in samples
+		SharedCounter m_Head; // written only by the emulation thread
+		SharedCounter m_Tail; // written only by the draining side
+		SharedCounter m_Underruns;
+		SharedCounter m_Overruns;
+		bool m_Started;
 
 #if defined(USE_THREADS)
 		pthread_t m_Thread;
-		volatile bool m_isExit;
-		pthread_mutex_t m_BufferMutex;
-		pthread_cond_t m_hasBuffer;
-		std::vector<uint8> m_PlayingBuffer;
-		std::vector<uint8> m_Buffering;
-		int m_WrittenSize; // for dynamic rate control
+		std::atomic<bool> m_isExit;
+		sem_t m_hasData;
 
 		static void* AudioOutputThreadEntry(void* arg)
 		{
@@ -297,25 +343,10 @@ namespace {
 
 		void AudioOutputThread()
 		{
-			while (true)
+			while (!m_isExit)
 			{
-				pthread_mutex_lock(&m_BufferMutex);
-				{
-					pthread_cond_wait(&m_hasBuffer, &m_BufferMutex);
-					if (m_isExit)
-					{
-						return;
-					}
-					m_PlayingBuffer.swap(m_Buffering);
-					m_WrittenSize = 0;
-				}
-				pthread_mutex_unlock(&m_BufferMutex);
-
-				if (! m_PlayingBuffer.empty())
-				{
-					WriteImpl(&m_PlayingBuffer[0], m_PlayingBuffer.size());
-					m_PlayingBuffer.resize(0);
-				}
+				sem_wait(&m_hasData);
+				Drain(true);
 			}
 		}
 #endif // USE_THREADS
@@ -360,6 +391,11 @@ void S9xExtraUsage (void)
 	S9xMessage(S9X_INFO, S9X_USAGE, "                                frames (use with -dumpstreams)");
 	S9xMessage(S9X_INFO, S9X_USAGE, "");
 
+	S9xMessage(S9X_INFO, S9X_USAGE, "-maxframeskip <num>             Most frames skipped in a row with auto frameskip");
+	S9xMessage(S9X_INFO, S9X_USAGE, "-frameskiplatency <num>         Milliseconds a frame may finish late and still");
+	S9xMessage(S9X_INFO, S9X_USAGE, "                                be rendered with auto frameskip");
+	S9xMessage(S9X_INFO, S9X_USAGE, "");
+
 	S9xMessage(S9X_INFO, S9X_USAGE, "-rwbuffersize                   Rewind buffer size in MB");
 	S9xMessage(S9X_INFO, S9X_USAGE, "-rwgranularity                  Rewind granularity in frames");
 	S9xMessage(S9X_INFO, S9X_USAGE, "");
@@ -463,6 +499,22 @@ void S9xParseArg (char **argv, int &i, int argc)
 	if (!strcasecmp(argv[i], "-dumpmaxframes"))
 		Settings.DumpStreamsMaxFrames = atoi(argv[++i]);
 	else
+	if (!strcasecmp(argv[i], "-maxframeskip"))
+	{
+		if (i + 1 < argc)
+			Settings.AutoMaxSkipFrames = atoi(argv[++i]);
+		else
+			S9xUsage();
+	}
+	else
+	if (!strcasecmp(argv[i], "-frameskiplatency"))
+	{
+		if (i + 1 < argc)
+			unixSettings.FrameSkipLatency = atoi(argv[++i]);
+		else
+			S9xUsage();
+	}
+	else
 	if (!strcasecmp(argv[i], "-rwbuffersize"))
 	{
 		if (i + 1 < argc)
@@ -586,6 +638,9 @@ void S9xParsePortConfig (ConfigFile &conf, int pass)
 	unixSettings.SoundFragmentSize = conf.GetUInt     ("Unix::SoundFragmentSize",   2048);
 	sound_device                   = conf.GetStringDup("Unix::SoundDevice",         "/dev/dsp");
 
+	Settings.AutoMaxSkipFrames     = conf.GetUInt     ("Unix::AutoMaxFrameSkip",    9);
+	unixSettings.FrameSkipLatency  = conf.GetUInt     ("Unix::FrameSkipLatency",    4);
+
 	keymaps.clear();
 	if (!conf.GetBool("Unix::ClearAllControls", false))
 	{
@@ -881,6 +936,8 @@ void S9xSyncSpeed (void)
 	}
 
 	static struct timeval	next1 = { 0, 0 };
+	static struct timeval	work_start = { 0, 0 };
+	static int32			cost_render = 0, cost_skip = 0;
 	struct timeval			now;
 
 	while (gettimeofday(&now, NULL) == -1) ;
@@ -892,15 +949,45 @@ void S9xSyncSpeed (void)
 		next1.tv_usec++;
 	}
 
-	// If we're on AUTO_FRAMERATE, we'll display frames always only if there's excess time.
-	// Otherwise we'll display the defined amount of frames.
-	unsigned	limit = (Settings.SkipFrames == AUTO_FRAMERATE) ? (timercmp(&next1, &now, <) ? 10 : 1) : Settings.SkipFrames;
+	// Time spent on the frame just emulated, apart from the sleep below.
+	// Averaged separately for rendered and skipped frames, the difference
+	// being what rendering costs.
+	if (work_start.tv_sec != 0)
+	{
+		int32	cost = (now.tv_sec - work_start.tv_sec) * 1000000 + now.tv_usec - work_start.tv_usec;
 
-	IPPU.RenderThisFrame = (++IPPU.SkippedFrames >= limit) ? TRUE : FALSE;
+		if (cost >= 0 && cost < 500000)
+		{
+			int32	&average = IPPU.RenderThisFrame ? cost_render : cost_skip;
+			average = average ? average + (cost - average) / 8 : cost;
+		}
+	}
 
-	if (IPPU.RenderThisFrame)
-		IPPU.SkippedFrames = 0;
+	if (Settings.SkipFrames == AUTO_FRAMERATE)
+	{
+		// Render the next frame if it's expected to be done before its time
+		// is up, give or take the latency allowed. Waiting for next1 comes
+		// first when we're ahead. Skipping is of no use when skipped frames
+		// take as long as rendered ones.
+		struct timeval	start = timercmp(&next1, &now, >) ? next1 : now;
+		int32			slack = (next1.tv_sec - start.tv_sec) * 1000000 + next1.tv_usec - start.tv_usec +
+								Settings.FrameTime + unixSettings.FrameSkipLatency * 1000;
+		bool8			saves = !cost_skip || cost_skip < cost_render;
+
+		IPPU.RenderThisFrame = (cost_render <= slack || !saves || IPPU.SkippedFrames >= Settings.AutoMaxSkipFrames) ? TRUE : FALSE;
+		if (IPPU.RenderThisFrame)
+			IPPU.SkippedFrames = 0;
+		else
+			IPPU.SkippedFrames++;
+	}
 	else
+	{
+		IPPU.RenderThisFrame = (++IPPU.SkippedFrames >= Settings.SkipFrames) ? TRUE : FALSE;
+		if (IPPU.RenderThisFrame)
+			IPPU.SkippedFrames = 0;
+	}
+
+	if (!IPPU.RenderThisFrame)
 	{
 		// If we were behind the schedule, check how much it is.
 		if (timercmp(&next1, &now, <))
@@ -927,6 +1014,8 @@ void S9xSyncSpeed (void)
 		// Continue with a while-loop because usleep() could be interrupted by a signal.
 	}
 
+	work_start = now;
+
 	// Calculate the timestamp of the next frame.
 	next1.tv_usec += Settings.FrameTime;
 	if (next1.tv_usec >= 1000000)
@@ -1328,8 +1417,6 @@ void S9xSamplesAvailable(void *data)
 #ifndef NOSOUND
 
     int samples_to_write;
-	static uint8 *sound_buffer = NULL;
-	static int sound_buffer_size = 0;
 
     if (Settings.DynamicRateControl)
     {
@@ -1338,18 +1425,10 @@ void S9xSamplesAvailable(void *data)
 
     samples_to_write = S9xGetSampleCount();
 
-    if (samples_to_write < 0)
+    if (samples_to_write <= 0)
         return;
 
-    if (sound_buffer_size < samples_to_write * 2)
-    {
-        sound_buffer = (uint8 *)realloc(sound_buffer, samples_to_write * 2);
-        sound_buffer_size = samples_to_write * 2;
-    }
-
-    S9xMixSamples(sound_buffer, samples_to_write);
-
-    s_AudioOutput->Write(sound_buffer, samples_to_write * 2);
+    s_AudioOutput->Mix(samples_to_write);
 #endif
 }
 
@@ -1414,7 +1493,13 @@ void S9xExit (void)
 #endif
 
 #ifndef NOSOUND
-	delete s_AudioOutput;
+	if (s_AudioOutput)
+	{
+		if (s_AudioOutput->GetUnderruns() || s_AudioOutput->GetOverruns())
+			printf("Sound: %u underruns, %u overruns\n", (unsigned) s_AudioOutput->GetUnderruns(), (unsigned) s_AudioOutput->GetOverruns());
+		delete s_AudioOutput;
+		s_AudioOutput = NULL;
+	}
 #endif
 
 	Memory.SaveSRAM(S9xGetFilename(".srm", SRAM_DIR));
@@ -1470,6 +1555,7 @@ int main (int argc, char **argv)
 	Settings.SnapshotScreenshots = TRUE;
 	Settings.SkipFrames = AUTO_FRAMERATE;
 	Settings.TurboSkipFrames = 15;
+	Settings.AutoMaxSkipFrames = 9;
 	Settings.CartAName[0] = 0;
 	Settings.CartBName[0] = 0;
 #ifdef NETPLAY_SUPPORT
@@ -1488,6 +1574,8 @@ int main (int argc, char **argv)
 	unixSettings.rewindBufferSize = 0;
 	unixSettings.rewindGranularity = 1;
 
+	unixSettings.FrameSkipLatency = 4;
+
 	memset(&so, 0, sizeof(so));
 
 	rewinding = false;
@@ -88,6 +88,7 @@ struct GUIData
 	Window			window;
 	Image			*image;
 	uint8			*snes_buffer;
+	uint8			*snes_buffer32;
 	uint8			*filter_buffer;
 	uint8			*blit_screen;
 	uint32			blit_screen_pitch;
@@ -173,6 +174,7 @@ static void TakedownXvImage (void);
 static void Repaint (bool8);
 static void Convert16To24 (int, int);
 static void Convert16To24Packed (int, int);
+static void Copy32 (int, int);
 
 
 void S9xExtraDisplayUsage (void)
@@ -956,6 +958,25 @@ static void SetupImage (void)
 	}
 	if (GUI.need_convert) { printf("\tImage conversion needed before blit.\n"); }
 
+	// Blocky mode on an XRGB8888 visual only repeats pixels, so take the 32-bit
+	// screen the core keeps as it renders instead of blitting and converting
+	GFX.Screen32 = NULL;
+#ifdef USE_XVIDEO
+	if (!GUI.use_xvideo)
+#endif
+	if (GUI.need_convert && GUI.video_mode == VIDEOMODE_BLOCKY && GUI.image->bits_per_pixel == 32 &&
+		GUI.red_shift == 16 && GUI.green_shift == 8 && GUI.blue_shift == 0 &&
+		GUI.red_size == 0xff && GUI.green_size == 0xff && GUI.blue_size == 0xff)
+	{
+		GFX.Pitch32 = SNES_WIDTH * 2 * 4;
+		GUI.snes_buffer32 = (uint8 *) calloc(GFX.Pitch32 * (SNES_HEIGHT_EXTENDED * 2), 1);
+		if (!GUI.snes_buffer32)
+			FatalError("Failed to allocate GUI.snes_buffer32.");
+
+		GFX.Screen32 = (uint32 *) GUI.snes_buffer32;
+		printf("\tUsing the 32-bit screen.\n");
+	}
+
 	S9xGraphicsInit();
 }
 
@@ -967,6 +988,13 @@ static void TakedownImage (void)
 		GUI.snes_buffer = NULL;
 	}
 
+	if (GUI.snes_buffer32)
+	{
+		free(GUI.snes_buffer32);
+		GUI.snes_buffer32 = NULL;
+		GFX.Screen32 = NULL;
+	}
+
 	if (GUI.filter_buffer)
 	{
 		free(GUI.filter_buffer);
@@ -1263,14 +1291,19 @@ void S9xPutImage (int width, int height)
 		copyHeight = height;
 		blitFn = S9xBlitPixSimple1x1;
 	}
-	blitFn((uint8 *) GFX.Screen, GFX.Pitch, GUI.blit_screen, GUI.blit_screen_pitch, width, height);
+	if (GFX.Screen32)
+		Copy32(width, height);
+	else
+		blitFn((uint8 *) GFX.Screen, GFX.Pitch, GUI.blit_screen, GUI.blit_screen_pitch, width, height);
 
 	if (height < prevHeight)
 	{
-		int	p = GUI.blit_screen_pitch >> 2;
+		uint8	*screen = GFX.Screen32 ? (uint8 *) GUI.image->data : GUI.blit_screen;
+		int		pitch   = GFX.Screen32 ? GUI.image->bytes_per_line : GUI.blit_screen_pitch;
+		int		p = pitch >> 2;
 		for (int y = SNES_HEIGHT * 2; y < SNES_HEIGHT_EXTENDED * 2; y++)
 		{
-			uint32	*d = (uint32 *) (GUI.blit_screen + y * GUI.blit_screen_pitch);
+			uint32	*d = (uint32 *) (screen + y * pitch);
 			for (int x = 0; x < p; x++)
 				*d++ = 0;
 		}
@@ -1310,7 +1343,7 @@ void S9xPutImage (int width, int height)
 	}
 	else
 #endif
-	if (GUI.need_convert)
+	if (GUI.need_convert && !GFX.Screen32)
 	{
 		if (GUI.bytes_per_pixel == 3)
 			Convert16To24Packed(copyWidth, copyHeight);
@@ -1426,6 +1459,32 @@ static void Convert16To24Packed (int width, int height)
 	}
 }
 
+// Blocky scaling straight from GFX.Screen32 into the image, doubling what the
+// blitters would
+static void Copy32 (int width, int height)
+{
+	int	xscale = (width  <= SNES_WIDTH)           ? 2 : 1;
+	int	yscale = (height <= SNES_HEIGHT_EXTENDED) ? 2 : 1;
+
+	for (int y = 0; y < height; y++)
+	{
+		uint32	*s = (uint32 *) ((uint8 *) GFX.Screen32 + y * GFX.Pitch32);
+		uint8	*row = (uint8 *) GUI.image->data + y * yscale * GUI.image->bytes_per_line;
+
+		if (xscale == 2)
+		{
+			uint32	*d = (uint32 *) row;
+			for (int x = 0; x < width; x++, d += 2)
+				d[0] = d[1] = s[x];
+		}
+		else
+			memcpy(row, s, width * 4);
+
+		if (yscale == 2)
+			memcpy(row + GUI.image->bytes_per_line, row, width * xscale * 4);
+	}
+}
+
 static void Repaint (bool8 isFrameBoundry)
 {
 #ifdef USE_XVIDEO